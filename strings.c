@@ -4,9 +4,57 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "strings.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define STRING_X86
+	#include <immintrin.h>
+#endif
+
+// atomics for the buffers shared by String_share, for String_ConcurrentIntern and for publishing the
+// SIMD kernels
+#ifdef __GNUC__
+	#define STRING_ATOMIC_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+	#define STRING_ATOMIC_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+	// every kernel is valid on its own, so calls need no ordering with the other kernels
+	#define STRING_KERNEL(k) __atomic_load_n(&(k), __ATOMIC_RELAXED)
+	#define STRING_ATOMIC_CAS(p, expected, desired) \
+		__atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+	#define STRING_ATOMIC_ADD(p, n) __atomic_fetch_add(p, n, __ATOMIC_RELAXED)
+	// decrements and returns the new value, ordering earlier accesses before a free by another thread
+	#define STRING_ATOMIC_DEC(p) __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL)
+#else // not thread-safe
+	#define STRING_ATOMIC_LOAD(p) (*(p))
+	#define STRING_ATOMIC_STORE(p, v) (*(p) = (v))
+	#define STRING_KERNEL(k) (k)
+	#define STRING_ATOMIC_CAS(p, expected, desired) \
+		(*(p) == *(expected) ? (*(p) = (desired), true) : (*(expected) = *(p), false))
+	#define STRING_ATOMIC_ADD(p, n) ((*(p) += (n)) - (n))
+	#define STRING_ATOMIC_DEC(p) (--*(p))
+#endif
+
+// SIMD kernels are selected once, on first use, from the best instruction set supported by the CPU.
+// The STRINGS_SIMD environment variable or String_simd_select() can force a lower level
+
+enum {
+	STRING_SIMD_SCALAR,
+	STRING_SIMD_SSE2,
+	STRING_SIMD_SSSE3,
+	STRING_SIMD_AVX2,
+	STRING_SIMD_COUNT
+};
+
+static char const * const String_simd_names[STRING_SIMD_COUNT] = {
+	[STRING_SIMD_SCALAR] = "scalar",
+	[STRING_SIMD_SSE2] = "sse2",
+	[STRING_SIMD_SSSE3] = "ssse3",
+	[STRING_SIMD_AVX2] = "avx2",
+};
+
+static int String_simd = -1;
+
 String const WHITESPACE = {
 	.str = " \t\f\n\r\v",
 	.size = 6
@@ -20,52 +68,214 @@ String const EMPTY_STRING = {
 #define UPPER_TO_LOWER_OFFSET 32
 
 _Bool String_is_empty(String const * str) {
-	return str->size == 0;
+	return String_len(str) == 0;
+}
+
+// the size of any String, kept with the flag in the last byte of an inline string
+static inline void String_set_len(String * str, ptrdiff_t size) {
+	if (String_is_inline(str)) {
+		str->capacity = (str->capacity & ~(~(size_t)0 << STRING_SSO_SHIFT)) | STRING_SSO_FLAG | 
+			(size_t)size << STRING_SSO_SHIFT;
+	} else {
+		str->size = size;
+	}
 }
 
 void String_clear(String * str) {
-	str->size = 0;
+	String_set_len(str, 0);
+}
+
+// mismatch kernels return the index of the first byte where a[:n] and b[:n] differ or n
+typedef ptrdiff_t (*String_MismatchKernel)(char const * a, char const * b, ptrdiff_t n);
+
+static ptrdiff_t String_mismatch_resolve(char const * a, char const * b, ptrdiff_t n);
+
+static String_MismatchKernel String_mismatch_kernel = String_mismatch_resolve;
+
+// compares a word at a time and locates the byte within the first differing word
+static ptrdiff_t String_mismatch_word(char const * a, char const * b, ptrdiff_t n) {
+	ptrdiff_t i = 0;
+	for ( ; i + 8 <= n; i += 8) {
+		uint64_t x, y;
+		memcpy(&x, a + i, sizeof(x));
+		memcpy(&y, b + i, sizeof(y));
+		if (x != y) {
+			break;
+		}
+	}
+	while (i < n && a[i] == b[i]) {
+		i++;
+	}
+	return i;
+}
+
+#ifdef STRING_X86
+
+__attribute__((target("sse2")))
+static ptrdiff_t String_mismatch_sse2(char const * a, char const * b, ptrdiff_t n) {
+	ptrdiff_t i = 0;
+	for ( ; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(a + i));
+		__m128i y = _mm_loadu_si128((__m128i const *)(b + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + String_mismatch_word(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static ptrdiff_t String_mismatch_avx2(char const * a, char const * b, ptrdiff_t n) {
+	ptrdiff_t i = 0;
+	for ( ; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(a + i));
+		__m256i y = _mm256_loadu_si256((__m256i const *)(b + i));
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + String_mismatch_sse2(a + i, b + i, n - i);
 }
 
+#endif // STRING_X86
+
+// compares bytes as unsigned and then sizes, so embedded nulls are ordinary characters
 int String_compare(String const * a, String const * b) {
 	ptrdiff_t size_a = String_len(a);
 	ptrdiff_t size_b = String_len(b);
-	int result = 0;
-	if (size_a < size_b) {
-		if (!size_a) {
-			return -1;
-		}
-		result = strncmp(a->str, b->str, size_a);
-		if (!result) { // the first size_a characters match. a is a substring of b
-			result = -1;
+	ptrdiff_t n = size_a < size_b ? size_a : size_b;
+	if (n > 0) {
+		ptrdiff_t i = STRING_KERNEL(String_mismatch_kernel)(String_data(a), String_data(b), n);
+		if (i < n) {
+			return (int)(unsigned char)String_data(a)[i] - (int)(unsigned char)String_data(b)[i];
 		}
-	} else if (size_a > size_b) {
-		if (!size_b) {
-			return 1;
-		}
-		result = strncmp(a->str, b->str, size_b);
-		if (!result) { // the first size_b characters match. b is a substring of a
-			result = 1;
+	}
+	return (size_a > size_b) - (size_a < size_b);
+}
+_Bool String_equal(String const * a, String const * b) {
+	ptrdiff_t n = String_len(a);
+	return n == String_len(b) && 
+		(n <= 0 || STRING_KERNEL(String_mismatch_kernel)(String_data(a), String_data(b), n) == n);
+}
+ptrdiff_t String_common_prefix_len(String const * a, String const * b) {
+	ptrdiff_t n = String_len(a) < String_len(b) ? String_len(a) : String_len(b);
+	return n > 0 ? STRING_KERNEL(String_mismatch_kernel)(String_data(a), String_data(b), n) : 0;
+}
+
+// wyhash (final version 4). the core is a 64 x 64 -> 128 bit multiply folded to 64 bits, which 
+// mixes better and runs faster on short keys than any SIMD hash
+static uint64_t const String_wysecret[4] = {
+	0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL
+};
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 String_uint128;
+#endif
+
+static inline void String_wymum(uint64_t * a, uint64_t * b) {
+#ifdef __SIZEOF_INT128__
+	String_uint128 r = (String_uint128)*a * *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+static inline uint64_t String_wymix(uint64_t a, uint64_t b) {
+	String_wymum(&a, &b);
+	return a ^ b;
+}
+static inline uint64_t String_wyr8(unsigned char const * p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+static inline uint64_t String_wyr4(unsigned char const * p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+static inline uint64_t String_wyr3(unsigned char const * p, size_t k) {
+	return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t String_hash(String const * str, uint64_t seed) {
+	uint64_t const * s = String_wysecret;
+	unsigned char const * p = (unsigned char const *)String_data(str);
+	size_t len = String_len(str) > 0 ? (size_t)String_len(str) : 0;
+	uint64_t a, b;
+	seed ^= String_wymix(seed ^ s[0], s[1]);
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (String_wyr4(p) << 32) | String_wyr4(p + ((len >> 3) << 2));
+			b = (String_wyr4(p + len - 4) << 32) | String_wyr4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = String_wyr3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
 		}
 	} else {
-		if (!size_a) {
-			return 0;
+		size_t i = len;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = String_wymix(String_wyr8(p) ^ s[1], String_wyr8(p + 8) ^ seed);
+				see1 = String_wymix(String_wyr8(p + 16) ^ s[2], String_wyr8(p + 24) ^ see1);
+				see2 = String_wymix(String_wyr8(p + 32) ^ s[3], String_wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = String_wymix(String_wyr8(p) ^ s[1], String_wyr8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
 		}
-		result = strncmp(a->str, b->str, size_a);
+		a = String_wyr8(p + i - 16);
+		b = String_wyr8(p + i - 8);
 	}
-	return result;
+	a ^= s[1];
+	b ^= seed;
+	String_wymum(&a, &b);
+	return String_wymix(a ^ s[0] ^ len, b ^ s[1]);
+}
+// a seed for each hash table, so that keys chosen to collide in one table do not collide in the 
+// others. mixes a process-wide count with the address of the table, which varies between runs
+static size_t String_table_seeds;
+static uint64_t String_table_seed(void const * table) {
+	uint64_t n = STRING_ATOMIC_ADD(&String_table_seeds, 1);
+	return String_wymix((uint64_t)(uintptr_t)table ^ String_wysecret[2], n ^ String_wysecret[3]);
+}
+void String_Hashed_init(String_Hashed * key, String const * str, uint64_t seed) {
+	key->str = *str;
+	key->hash = String_hash(str, seed);
+}
+_Bool String_Hashed_equal(String_Hashed const * a, String_Hashed const * b) {
+	return a->hash == b->hash && String_equal(&a->str, &b->str);
 }
 
 _Bool String_in(String const * str, String const * restrict other) {
-	return 0 < String_count(str, other, 0, 0);
+	return 0 <= String_find(str, other, 0, 0);
 }
 
 _Bool String_char_in(String const * str, char val) {
-	if (str->size <= 0) {
+	ptrdiff_t size = String_len(str);
+	if (size <= 0) {
 		return false;
 	}
-	char const * str_ = str->str;
-	for (ptrdiff_t i = 0; i < str->size; i++) {
+	char const * str_ = String_data(str);
+	for (ptrdiff_t i = 0; i < size; i++) {
 		if (str_[i] == val) {
 			return true;
 		}
@@ -73,556 +283,3773 @@ _Bool String_char_in(String const * str, char val) {
 	return false;
 }
 
+#define STRING_BYTES4(b) (b), (b) + 1, (b) + 2, (b) + 3
+#define STRING_BYTES16(b) STRING_BYTES4(b), STRING_BYTES4((b) + 4), STRING_BYTES4((b) + 8), \
+	STRING_BYTES4((b) + 12)
+
+static unsigned char const String_identity_table[UCHAR_MAX + 1] = {
+	STRING_BYTES16(0x00), STRING_BYTES16(0x10), STRING_BYTES16(0x20), STRING_BYTES16(0x30),
+	STRING_BYTES16(0x40), STRING_BYTES16(0x50), STRING_BYTES16(0x60), STRING_BYTES16(0x70),
+	STRING_BYTES16(0x80), STRING_BYTES16(0x90), STRING_BYTES16(0xA0), STRING_BYTES16(0xB0),
+	STRING_BYTES16(0xC0), STRING_BYTES16(0xD0), STRING_BYTES16(0xE0), STRING_BYTES16(0xF0)
+};
+// case kernels flip the case bit of the bytes of src[:n] in 'first'...'first' + 25 and write them
+// to dst, which may be src. 'first' is 'A' to lower and 'a' to upper
+typedef void (*String_CaseKernel)(char * dst, char const * src, ptrdiff_t n, char first);
+
+static void String_case_resolve(char * dst, char const * src, ptrdiff_t n, char first);
+
+static String_CaseKernel String_case_kernel = String_case_resolve;
+
+// 8 bytes at a time in a 64-bit word. the high bit of each byte of 'ge' and 'gt' is set if its low
+// 7 bits are >= first and > first + 25 respectively, and no carry crosses a byte
+static void String_case_swar(char * dst, char const * src, ptrdiff_t n, char first) {
+	uint64_t const ones = 0x0101010101010101ULL;
+	uint64_t const high = 0x8080808080808080ULL;
+	uint64_t const add_ge = (0x80 - (unsigned char)first) * ones;
+	uint64_t const add_gt = (0x80 - (unsigned char)first - 26) * ones;
+	ptrdiff_t i = 0;
+	for ( ; i + 8 <= n; i += 8) {
+		uint64_t x;
+		memcpy(&x, src + i, sizeof(x));
+		uint64_t low = x & ~high;
+		uint64_t in = (low + add_ge) & ~(low + add_gt) & ~x & high;
+		x ^= in >> 2;
+		memcpy(dst + i, &x, sizeof(x));
+	}
+	for ( ; i < n; i++) {
+		dst[i] = (unsigned char)(src[i] - first) < 26 ? src[i] ^ UPPER_TO_LOWER_OFFSET : src[i];
+	}
+}
+
+#ifdef STRING_X86
+
+// the letters are those that are less than first - 128 + 26 in signed comparison after subtracting
+// first - 128
+__attribute__((target("sse2")))
+static void String_case_sse2(char * dst, char const * src, ptrdiff_t n, char first) {
+	__m128i const shift = _mm_set1_epi8((char)(first - 128));
+	__m128i const limit = _mm_set1_epi8(-128 + 26);
+	__m128i const bit = _mm_set1_epi8(UPPER_TO_LOWER_OFFSET);
+	ptrdiff_t i = 0;
+	for ( ; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(src + i));
+		__m128i in = _mm_cmplt_epi8(_mm_sub_epi8(x, shift), limit);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(x, _mm_and_si128(in, bit)));
+	}
+	String_case_swar(dst + i, src + i, n - i, first);
+}
+
+__attribute__((target("avx2")))
+static void String_case_avx2(char * dst, char const * src, ptrdiff_t n, char first) {
+	__m256i const shift = _mm256_set1_epi8((char)(first - 128));
+	__m256i const limit = _mm256_set1_epi8(-128 + 26);
+	__m256i const bit = _mm256_set1_epi8(UPPER_TO_LOWER_OFFSET);
+	ptrdiff_t i = 0;
+	for ( ; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(src + i));
+		__m256i in = _mm256_cmpgt_epi8(limit, _mm256_sub_epi8(x, shift));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(x, _mm256_and_si256(in, bit)));
+	}
+	String_case_sse2(dst + i, src + i, n - i, first);
+}
+
+#endif // STRING_X86
+
+// makes a shared string the only owner of its bytes and gives a view its own copy before the bytes 
+// are written in place. returns -1 on allocation failure
+static int String_unshare(String * str);
+
 void String_lower(String * str) {
-	for (ptrdiff_t i = 0; i < str->size; i++) {
-		char c = str->str[i];
-		if (c >= 'A' && c <= 'Z') {
-			str->str[i] = c + UPPER_TO_LOWER_OFFSET;
-		}
+	if (String_len(str) > 0 && !String_unshare(str)) {
+		STRING_KERNEL(String_case_kernel)(String_data(str), String_data(str), String_len(str), 'A');
 	}
 }
 void String_upper(String * str) {
-	for (ptrdiff_t i = 0; i < str->size; i++) {
-		char c = str->str[i];
-		if (c >= 'a' && c <= 'z') {
-			str->str[i] = c - UPPER_TO_LOWER_OFFSET;
-		}
+	if (String_len(str) > 0 && !String_unshare(str)) {
+		STRING_KERNEL(String_case_kernel)(String_data(str), String_data(str), String_len(str), 'a');
 	}
 }
 char String_get(String const * str, ptrdiff_t loc) {
-	if (str->size <= 0) {
+	if (String_len(str) <= 0) {
 		return '\0';
 	}
 	if (loc < 0) {
-		loc = str->size - 1 + ((loc + 1) % str->size);
+		loc = String_len(str) - 1 + ((loc + 1) % String_len(str));
 	}
-	if (loc < str->size) {
-		return str->str[loc];
+	if (loc < String_len(str)) {
+		return String_data(str)[loc];
 	}
 	return '\0';
 }
 char String_set(String * str, ptrdiff_t loc, char val) {
-	if (str->size <= 0) {
+	if (String_len(str) <= 0) {
 		return '\0';
 	}
 	if (loc < 0) {
-		loc = str->size - 1 + ((loc + 1) % str->size);
+		loc = String_len(str) - 1 + ((loc + 1) % String_len(str));
 	}
 	char out = '\0';
-	if (loc < str->size) {
-		out = str->str[loc];
-		str->str[loc] = val;
+	if (loc < String_len(str) && !String_unshare(str)) {
+		out = String_data(str)[loc];
+		String_data(str)[loc] = val;
 	}
 	return out;
 }
 _Bool String_starts_with(String const * restrict str, String const * restrict prefix) {
-	if (str->size < prefix->size || prefix->size < 0) {
+	ptrdiff_t n = String_len(prefix);
+	if (String_len(str) < n || n < 0) {
 		return false;
 	}
-	char const * str_ = str->str;
-	char const * pre_ = prefix->str;
-	for (ptrdiff_t i = 0; i < prefix->size; i++) {
-		if (str_[i] != pre_[i]) {
-			return false;
-		}
-	}
-	return true;
+	return !n || STRING_KERNEL(String_mismatch_kernel)(String_data(str), String_data(prefix), n) == n;
 }
 _Bool String_ends_with(String const * restrict str, String const * restrict suffix) {
-	if (str->size < suffix->size || suffix->size < 0) {
+	ptrdiff_t n = String_len(suffix);
+	if (String_len(str) < n || n < 0) {
 		return false;
 	}
-	char const * str_ = str->str + (str->size - suffix->size);
-	char const * pre_ = suffix->str;
-	for (ptrdiff_t i = 0; i < suffix->size; i++) {
-		if (str_[i] != pre_[i]) {
-			return false;
-		}
-	}
-	return true;
+	return !n || STRING_KERNEL(String_mismatch_kernel)(String_data(str) + (String_len(str) - n), 
+		String_data(suffix), n) == n;
 }
-int String_count(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end) {
-	int ct = 0;
-	if (0 >= sub->size || 0 >= str->size) {
-		return ct;
+// normalizes the [start, end) arguments of the search functions against the size of 'str'. end == 0
+// is taken as the end of the string. returns false if the resulting range is empty
+static _Bool String_range(String const * str, ptrdiff_t * start, ptrdiff_t * end) {
+	ptrdiff_t size = String_len(str);
+	if (*start < 0) {
+		*start += size * (*start / size) - (*start % size);
 	}
-	if (start < 0) {
-		start += str->size * (start / str->size) - (start % str->size);
+	if (*end < 0) {
+		*end += size * (*end / size) - (*end % size);
 	}
-	if (end < 0) {
-		end += str->size * (end / str->size) - (end % str->size);
+	if (0 == *end || *end > size) {
+		*end = size;
 	}
-	if (0 == end) {
-		end += str->size;
+	return *start < *end;
+}
+
+// Two-Way (Crochemore-Perrin) string matching. The needle is split once at a critical position into
+// needle[:suffix] and needle[suffix:]; a search then matches the right half forwards and the left
+// half backwards, which guarantees linear time in the size of the haystack with no allocation.
+// Reverse searches run the same algorithm over the reversed needle and haystack
+typedef struct String_TwoWay {
+	unsigned char const * needle;
+	ptrdiff_t size;
+	ptrdiff_t suffix; // the critical position
+	ptrdiff_t period; // the period of the needle if periodic, else a safe shift on a full mismatch
+	ptrdiff_t const * shift; // optional bad-character shifts on the last byte of the window
+	_Bool periodic;
+} String_TwoWay;
+
+// returns the index before the maximal suffix of 'needle' and sets 'period' to its period. 
+// 'reverse' selects the reversed alphabetical order. if 'backward', the needle is read back to front
+static ptrdiff_t String_max_suffix(unsigned char const * needle, ptrdiff_t size, _Bool reverse, 
+	_Bool backward, ptrdiff_t * period) {
+
+	ptrdiff_t ms = -1;
+	ptrdiff_t j = 0;
+	ptrdiff_t k = 1;
+	ptrdiff_t p = 1;
+	while (j + k < size) {
+		unsigned char a = backward ? needle[size - 1 - j - k] : needle[j + k];
+		unsigned char b = backward ? needle[size - 1 - ms - k] : needle[ms + k];
+		if (reverse ? a > b : a < b) { // suffix is smaller, period is the entire prefix so far
+			j += k;
+			k = 1;
+			p = j - ms;
+		} else if (a == b) { // advance through the repetition of the current period
+			if (k != p) {
+				k++;
+			} else {
+				j += p;
+				k = 1;
+			}
+		} else { // suffix is larger, start over from the current location
+			ms = j++;
+			k = p = 1;
+		}
 	}
-	if (start >= end) {
-		return 0;
+	*period = p;
+	return ms;
+}
+
+static void String_two_way_factor(String_TwoWay * tw, String const * needle, _Bool backward) {
+	unsigned char const * needle_ = (unsigned char const *)String_data(needle);
+	ptrdiff_t size = String_len(needle);
+	ptrdiff_t period = 1;
+	ptrdiff_t period_rev = 1;
+	ptrdiff_t ms = String_max_suffix(needle_, size, false, backward, &period);
+	ptrdiff_t ms_rev = String_max_suffix(needle_, size, true, backward, &period_rev);
+	// the critical position is the start of the longer of the two maximal suffixes
+	if (ms < ms_rev) {
+		ms = ms_rev;
+		period = period_rev;
+	}
+	*tw = (String_TwoWay) {
+		.needle = needle_,
+		.size = size,
+		.suffix = ms + 1,
+	};
+	// compare the left half against the bytes one period to its right (to its left if backward)
+	_Bool periodic = backward ? 
+		!memcmp(needle_ + size - ms - 1, needle_ + size - ms - 1 - period, ms + 1) :
+		!memcmp(needle_, needle_ + period, ms + 1);
+	if (periodic) {
+		tw->periodic = true;
+		tw->period = period;
+	} else {
+		tw->period = (ms + 1 > size - ms - 1 ? ms + 1 : size - ms - 1) + 1;
 	}
-	ptrdiff_t loc = String_find(&(String){.str = str->str + start, .size = end - start}, 
-								sub, 0, end - start);
-	while (loc >= 0) {
-		loc += start;
-		ct++;
-		if (loc < end - sub->size) {
-			start = loc + sub->size;
-			loc = String_find(&(String){.str = str->str + start, 
-					.size = end - start}, sub, 0, end - start);
-		} else {
-			loc = -1;
+}
+
+static void String_two_way_init(String_TwoWay * tw, String const * needle) {
+	String_two_way_factor(tw, needle, false);
+}
+
+// for use with String_two_way_rfind only
+static void String_two_way_rinit(String_TwoWay * tw, String const * needle) {
+	String_two_way_factor(tw, needle, true);
+}
+
+// String_two_way_find for needles with a shift table. each window first checks its last byte, which 
+// skips up to the full needle length on a mismatch (Horspool)
+static ptrdiff_t String_two_way_find_shift(String_TwoWay const * tw, char const * hay, 
+	ptrdiff_t size) {
+
+	ptrdiff_t const m = tw->size;
+	unsigned char const * needle = tw->needle;
+	unsigned char const * hay_ = (unsigned char const *)hay;
+	ptrdiff_t const * shift = tw->shift;
+	ptrdiff_t const suffix = tw->suffix;
+	ptrdiff_t memory = 0;
+	ptrdiff_t j = 0;
+	while (j <= size - m) {
+		ptrdiff_t skip = shift[hay_[j + m - 1]];
+		if (skip > 0) {
+			// a periodic needle with its last byte out of place cannot match before the mismatch
+			if (memory && skip < tw->period) {
+				skip = m - tw->period;
+			}
+			memory = 0;
+			j += skip;
+			continue;
+		}
+		// the last byte is already known to match
+		ptrdiff_t i = suffix > memory ? suffix : memory;
+		while (i < m - 1 && needle[i] == hay_[i + j]) {
+			i++;
+		}
+		if (i < m - 1) {
+			j += i - suffix + 1;
+			memory = 0;
+			continue;
+		}
+		i = suffix - 1;
+		while (i >= memory && needle[i] == hay_[i + j]) {
+			i--;
+		}
+		if (i < memory) {
+			return j;
+		}
+		j += tw->period;
+		if (tw->periodic) {
+			memory = m - tw->period;
 		}
 	}
-	return ct;
+	return -1;
 }
-// returns -1 if not found
-ptrdiff_t String_find(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end) {
-	if (0 >= sub->size || 0 >= str->size || str->size < sub->size) {
+
+// returns the offset of the first occurrence of the needle in hay[:size] or -1 if not found
+static ptrdiff_t String_two_way_find(String_TwoWay const * tw, char const * hay, ptrdiff_t size) {
+	ptrdiff_t const m = tw->size;
+	if (size < m) {
 		return -1;
 	}
-	if (start < 0) {
-		start += str->size * (start / str->size) - (start % str->size);
-	}
-	if (end < 0) {
-		end += str->size * (end / str->size) - (end % str->size);
-	}
-	if (0 == end) {
-		end += str->size;
+	if (m == 1) {
+		char const * loc = memchr(hay, tw->needle[0], size);
+		return loc ? loc - hay : -1;
 	}
-	if (start >= end) {
-		return -1;
+	if (tw->shift) {
+		return String_two_way_find_shift(tw, hay, size);
 	}
-	char init = sub->str[0];
-	char * str_ = str->str + start;
-	char const * end_ = str->str + end;
-	while (str_ < end_) {
-		if (String_starts_with(&(String){.str=str_, .size=end_-str_}, sub)) {
-			return str_ - str->str;
+	unsigned char const * needle = tw->needle;
+	unsigned char const * hay_ = (unsigned char const *)hay;
+	ptrdiff_t const suffix = tw->suffix;
+	ptrdiff_t memory = 0; // length of the left half known to match from the previous period
+	ptrdiff_t j = 0;
+	while (j <= size - m) {
+		ptrdiff_t i = suffix > memory ? suffix : memory;
+		while (i < m && needle[i] == hay_[i + j]) {
+			i++;
+		}
+		if (i < m) {
+			j += i - suffix + 1;
+			memory = 0;
+			continue;
+		}
+		i = suffix - 1;
+		while (i >= memory && needle[i] == hay_[i + j]) {
+			i--;
 		}
-		str_++;
-		while (str_ < end_ && *str_ != init) {
-			str_++;
+		if (i < memory) {
+			return j;
+		}
+		j += tw->period;
+		if (tw->periodic) {
+			memory = m - tw->period;
 		}
 	}
 	return -1;
 }
-ptrdiff_t String_rfind(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end) {
-	if (0 >= sub->size || 0 >= str->size || sub->size > str->size) {
+
+// returns the offset of the last occurrence of the needle in hay[:size] or -1 if not found. the
+// needle must have been factored by String_two_way_rinit
+static ptrdiff_t String_two_way_rfind(String_TwoWay const * tw, char const * hay, ptrdiff_t size) {
+	ptrdiff_t const m = tw->size;
+	if (size < m) {
 		return -1;
 	}
-	if (start < 0) {
-		start += str->size * (start / str->size) - (start % str->size);
-	}
-	if (end < 0) {
-		end += str->size * (end / str->size) - (end % str->size);
-	}
-	if (0 == end) {
-		end += str->size;
-	}
-	if (start + sub->size > end) {
+	if (m == 1) {
+		char const c = (char)tw->needle[0];
+		for (ptrdiff_t i = size - 1; i >= 0; i--) {
+			if (hay[i] == c) {
+				return i;
+			}
+		}
 		return -1;
 	}
-	char init = sub->str[0];
-	char * str_ = str->str + start;
-	ptrdiff_t final_end = sub->size + start;
-	String test = {.str = str_, .size = 0};
-	while (end >= final_end) {
-		test.size = end - start;
-		if (String_ends_with(&test, sub)) {
-			return end - sub->size;
+	// index j of the reversed haystack and i of the reversed needle map to hay_[-j - i] and
+	// needle[-i]
+	unsigned char const * needle = tw->needle + m - 1;
+	unsigned char const * hay_ = (unsigned char const *)hay + size - 1;
+	ptrdiff_t const suffix = tw->suffix;
+	ptrdiff_t memory = 0;
+	ptrdiff_t j = 0;
+	while (j <= size - m) {
+		ptrdiff_t i = suffix > memory ? suffix : memory;
+		while (i < m && needle[-i] == hay_[-i - j]) {
+			i++;
 		}
-		end--;
-		while (end >= final_end && str->str[end - sub->size] != init) {
-			end--;
+		if (i < m) {
+			j += i - suffix + 1;
+			memory = 0;
+			continue;
+		}
+		i = suffix - 1;
+		while (i >= memory && needle[-i] == hay_[-i - j]) {
+			i--;
+		}
+		if (i < memory) {
+			return size - m - j;
+		}
+		j += tw->period;
+		if (tw->periodic) {
+			memory = m - tw->period;
 		}
 	}
 	return -1;
 }
-void String_dest(String * str) {
-	// frees buffer only and resets. To use reallocatable method
-	if (str->capacity) {
-		free(str->str);
-		memset(str, 0, sizeof(*str));
+
+// writes the offsets of up to n, possibly overlapping, occurrences of the needle in hay[:size] to 
+// locs and returns the number written. unlike restarting String_two_way_find after every match, 
+// this stays linear for periodic needles whose occurrences overlap
+static ptrdiff_t String_two_way_find_all(String_TwoWay const * tw, char const * hay, ptrdiff_t size, 
+	ptrdiff_t * locs, ptrdiff_t n) {
+
+	ptrdiff_t const m = tw->size;
+	unsigned char const * needle = tw->needle;
+	unsigned char const * hay_ = (unsigned char const *)hay;
+	ptrdiff_t const suffix = tw->suffix;
+	ptrdiff_t memory = 0;
+	ptrdiff_t j = 0;
+	ptrdiff_t k = 0;
+	while (k < n && j <= size - m) {
+		ptrdiff_t i = suffix > memory ? suffix : memory;
+		while (i < m && needle[i] == hay_[i + j]) {
+			i++;
+		}
+		if (i < m) {
+			j += i - suffix + 1;
+			memory = 0;
+			continue;
+		}
+		i = suffix - 1;
+		while (i >= memory && needle[i] == hay_[i + j]) {
+			i--;
+		}
+		if (i < memory) {
+			locs[k++] = j;
+		}
+		j += tw->period;
+		if (tw->periodic) {
+			memory = m - tw->period;
+		}
 	}
+	return k;
 }
 
-void String_del(String * str) { 
-	// calls *_dest and then frees str
-	String_dest(str);
-	free(str);
-}
-void String_strip(String * str, String const * restrict chars) {
-	// whitespace if chars == NULL
-	if (str->size <= 0) {
-		return;
-	}
-	if (chars == NULL) {
-		chars = &WHITESPACE;
+// the number of bytes the filtering kernels may spend verifying candidates beyond the number of
+// bytes scanned before handing the rest of the haystack to the Two-Way kernel. keeps worst case
+// searches linear
+#define STRING_SIMD_VERIFY_SLACK 1024
+
+typedef ptrdiff_t (*String_FindKernel)(String_TwoWay const * tw, char const * hay, ptrdiff_t size);
+
+static ptrdiff_t String_find_resolve(String_TwoWay const * tw, char const * hay, ptrdiff_t size);
+
+static String_FindKernel String_find_kernel = String_find_resolve;
+
+#ifdef STRING_X86
+
+// the first-and-last-byte filter: compares a block of candidate positions against the first byte of
+// the needle and the same block shifted by m - 1 against its last byte, then verifies the positions
+// where both match
+__attribute__((target("sse2")))
+static ptrdiff_t String_find_sse2(String_TwoWay const * tw, char const * hay, ptrdiff_t size) {
+	ptrdiff_t const m = tw->size;
+	if (m == 1 || size < m + 15) {
+		return String_two_way_find(tw, hay, size);
+	}
+	char const * needle = (char const *)tw->needle;
+	__m128i const first = _mm_set1_epi8(needle[0]);
+	__m128i const last = _mm_set1_epi8(needle[m - 1]);
+	ptrdiff_t work = 0;
+	ptrdiff_t i = 0;
+	for ( ; i + m + 15 <= size && work <= i + STRING_SIMD_VERIFY_SLACK; i += 16) {
+		__m128i a = _mm_cmpeq_epi8(first, _mm_loadu_si128((__m128i const *)(hay + i)));
+		__m128i b = _mm_cmpeq_epi8(last, _mm_loadu_si128((__m128i const *)(hay + i + m - 1)));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+		while (mask) {
+			ptrdiff_t loc = i + __builtin_ctz(mask);
+			if (!memcmp(hay + loc + 1, needle + 1, m - 2)) {
+				return loc;
+			}
+			work += m;
+			mask &= mask - 1;
+		}
 	}
-	if (chars->size <= 0) {
-		return;
+	ptrdiff_t loc = String_two_way_find(tw, hay + i, size - i);
+	return loc < 0 ? -1 : i + loc;
+}
+
+__attribute__((target("avx2")))
+static ptrdiff_t String_find_avx2(String_TwoWay const * tw, char const * hay, ptrdiff_t size) {
+	ptrdiff_t const m = tw->size;
+	if (m == 1 || size < m + 31) {
+		return String_find_sse2(tw, hay, size);
+	}
+	char const * needle = (char const *)tw->needle;
+	__m256i const first = _mm256_set1_epi8(needle[0]);
+	__m256i const last = _mm256_set1_epi8(needle[m - 1]);
+	ptrdiff_t work = 0;
+	ptrdiff_t i = 0;
+	for ( ; i + m + 31 <= size && work <= i + STRING_SIMD_VERIFY_SLACK; i += 32) {
+		__m256i a = _mm256_cmpeq_epi8(first, _mm256_loadu_si256((__m256i const *)(hay + i)));
+		__m256i b = _mm256_cmpeq_epi8(last, _mm256_loadu_si256((__m256i const *)(hay + i + m - 1)));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+		while (mask) {
+			ptrdiff_t loc = i + __builtin_ctz(mask);
+			if (!memcmp(hay + loc + 1, needle + 1, m - 2)) {
+				return loc;
+			}
+			work += m;
+			mask &= mask - 1;
+		}
 	}
-	// run rstrip first so that the potential move in lstrip is moving less memory
-	String_rstrip(str, chars);
-	String_lstrip(str, chars);
+	ptrdiff_t loc = String_find_sse2(tw, hay + i, size - i);
+	return loc < 0 ? -1 : i + loc;
 }
-void String_lstrip(String * str, String const * restrict chars) {
-	// whitespace if chars == NULL
-	if (str->size <= 0) {
-		return;
+
+#endif // STRING_X86
+
+// the number of match locations buffered on the stack by functions that enumerate matches
+#define STRING_FIND_CHUNK 64
+
+// String_find_all on a raw buffer with a factored needle. offsets are relative to hay
+static ptrdiff_t String_find_all_tw(String_TwoWay const * tw, char const * hay, ptrdiff_t size, 
+	_Bool overlap, ptrdiff_t * locs, ptrdiff_t n) {
+
+	if (overlap && tw->periodic && tw->size > 1) {
+		return String_two_way_find_all(tw, hay, size, locs, n);
+	}
+	// otherwise occurrences are at least half a needle apart and restarting the kernel after each
+	// is linear
+	ptrdiff_t step = overlap ? 1 : tw->size;
+	ptrdiff_t pos = 0;
+	ptrdiff_t k = 0;
+	while (k < n) {
+		ptrdiff_t loc = STRING_KERNEL(String_find_kernel)(tw, hay + pos, size - pos);
+		if (loc < 0) {
+			break;
+		}
+		locs[k++] = pos + loc;
+		pos += loc + step;
 	}
-	if (chars == NULL) {
-		chars = &WHITESPACE;
+	return k;
+}
+static int String_count_tw(String const * str, String_TwoWay const * tw, ptrdiff_t start, 
+	ptrdiff_t end) {
+
+	int ct = 0;
+	if (0 >= String_len(str) || !String_range(str, &start, &end)) {
+		return ct;
 	}
-	if (chars->size <= 0) {
-		return;
+	ptrdiff_t locs[STRING_FIND_CHUNK];
+	ptrdiff_t nlocs = STRING_FIND_CHUNK;
+	while (nlocs == STRING_FIND_CHUNK) {
+		nlocs = String_find_all_tw(tw, String_data(str) + start, end - start, false, locs, STRING_FIND_CHUNK);
+		ct += (int)nlocs;
+		if (nlocs) {
+			start += locs[nlocs - 1] + tw->size;
+		}
 	}
-	ptrdiff_t itest = 0;
-	char * str_ = str->str;
-	while (itest < str->size && String_char_in(chars, str_[itest])) {
-		itest++;
+	return ct;
+}
+static ptrdiff_t String_find_tw(String const * str, String_TwoWay const * tw, ptrdiff_t start, 
+	ptrdiff_t end) {
+	
+	if (0 >= String_len(str) || String_len(str) < tw->size || !String_range(str, &start, &end)) {
+		return -1;
 	}
-	if (itest) {
-		str->size -= itest;
-		memmove(str->str, str->str + itest, str->size * sizeof(char));
+	ptrdiff_t loc = STRING_KERNEL(String_find_kernel)(tw, String_data(str) + start, end - start);
+	return loc < 0 ? -1 : start + loc;
+}
+int String_count(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end) {
+	if (0 >= String_len(sub)) {
+		return 0;
 	}
+	String_TwoWay tw;
+	String_two_way_init(&tw, sub);
+	return String_count_tw(str, &tw, start, end);
 }
-void String_rstrip(String * str, String const * restrict chars) {
-	// whitespace if chars == NULL
-	if (str->size <= 0) {
-		return;
+ptrdiff_t String_find_all(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end, 
+	_Bool overlap, ptrdiff_t * locs, ptrdiff_t n) {
+
+	if (0 >= String_len(sub) || 0 >= String_len(str) || n <= 0 || !String_range(str, &start, &end)) {
+		return 0;
 	}
-	if (chars == NULL) {
-		chars = &WHITESPACE;
+	String_TwoWay tw;
+	String_two_way_init(&tw, sub);
+	ptrdiff_t nlocs = String_find_all_tw(&tw, String_data(str) + start, end - start, overlap, locs, n);
+	for (ptrdiff_t i = 0; i < nlocs; i++) {
+		locs[i] += start;
 	}
-	if (chars->size <= 0) {
-		return;
+	return nlocs;
+}
+// returns -1 if not found
+ptrdiff_t String_find(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end) {
+	if (0 >= String_len(sub)) {
+		return -1;
 	}
-	char * str_ = str->str;
-	while (str->size > 0 && String_char_in(chars, str_[str->size - 1])) {
-		str->size--;
+	String_TwoWay tw;
+	String_two_way_init(&tw, sub);
+	return String_find_tw(str, &tw, start, end);
+}
+ptrdiff_t String_rfind(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end) {
+	if (0 >= String_len(sub) || 0 >= String_len(str) || String_len(sub) > String_len(str) || 
+		!String_range(str, &start, &end)) {
+		
+		return -1;
 	}
+	String_TwoWay tw;
+	String_two_way_rinit(&tw, sub);
+	ptrdiff_t loc = String_two_way_rfind(&tw, String_data(str) + start, end - start);
+	return loc < 0 ? -1 : start + loc;
+}
+// the allocator of a buffer is looked up in this order: the one it was created with, the one in use
+// by the thread (String_Allocator_use), the global one (String_Allocator_set) and malloc
+static void * String_malloc_alloc(void * ctx, size_t size) {
+	return malloc(size);
+}
+static void * String_malloc_realloc(void * ctx, void * p, size_t old_size, size_t size) {
+	return realloc(p, size);
+}
+static void String_malloc_free(void * ctx, void * p, size_t size) {
+	free(p);
 }
 
-// can fail if target string does not have large enough size or will reallocate underlying
-// buffer. failures are negative returns or null strings
+static String_Allocator const String_malloc_allocator = {
+	.alloc = String_malloc_alloc,
+	.realloc = String_malloc_realloc,
+	.free = String_malloc_free,
+};
 
-// internal function. resizes without clearing (as opposed to String_init(., ., 0, 0)
-String * String_resize(String * str, size_t new_capacity) {
-	char * str_ = realloc(str->str, new_capacity);
-	if (!str_) {
+static String_Allocator const * String_global_allocator = &String_malloc_allocator;
+#ifdef __GNUC__
+static __thread String_Allocator const * String_local_allocator = NULL;
+#else
+static String_Allocator const * String_local_allocator = NULL;
+#endif
+
+String_Allocator const * String_Allocator_set(String_Allocator const * allocator) {
+	allocator = allocator ? allocator : &String_malloc_allocator;
+	String_Allocator const * previous = STRING_ATOMIC_LOAD(&String_global_allocator);
+	while (!STRING_ATOMIC_CAS(&String_global_allocator, &previous, allocator)) {
+	}
+	return previous;
+}
+String_Allocator const * String_Allocator_use(String_Allocator const * allocator) {
+	String_Allocator const * previous = String_local_allocator;
+	String_local_allocator = allocator;
+	return previous;
+}
+static inline String_Allocator const * String_default_allocator(void) {
+	return String_local_allocator ? String_local_allocator : 
+		STRING_ATOMIC_LOAD(&String_global_allocator);
+}
+
+// patterns, maps, intern pools, builders and ropes take their own memory from the allocator in use
+// when they are made and keep it to grow and free with, as buffers do
+static void * String_obj_alloc(String_Allocator const * allocator, size_t size) {
+	return allocator->alloc(allocator->ctx, size);
+}
+// n zeroed elements of 'size' bytes
+static void * String_obj_calloc(String_Allocator const * allocator, size_t n, size_t size) {
+	if (allocator == &String_malloc_allocator) {
+		return calloc(n, size);
+	} else if (size && n > SIZE_MAX / size) {
 		return NULL;
 	}
-	str->str = str_;
-	str->capacity = new_capacity;
-	return str;
+	void * p = allocator->alloc(allocator->ctx, n * size);
+	if (p) {
+		memset(p, 0, n * size);
+	}
+	return p;
+}
+static void String_obj_free(String_Allocator const * allocator, void * p, size_t size) {
+	if (p && allocator->free) {
+		allocator->free(allocator->ctx, p, size);
+	}
 }
 
-// need to rework this garbage
-void String_init(String * restrict str, char const * restrict buf, ptrdiff_t size, size_t capacity) {
-	if (size) { // a buffer was provided
-		if (!capacity) { // no allocated capacity in String
-			capacity = (size_t)size == SIZE_MAX ? size : size + 1;
-			*str = (String) {
-				.str = calloc(capacity,  sizeof(char)),
-			};
-		} else { // this is fucked up
-			if (capacity < (size_t)size) { // reallocation is necessary
-				capacity = (size_t)size == SIZE_MAX ? size : size + 1;
-			}
-			char * str_ = NULL;
-			if (str->capacity) {
-				if (str->capacity < capacity) {
-					str_ = realloc(str->str, sizeof(char) * capacity);
-				} else {
-					str_ = str->str;
+// String_Arena hands out memory from large blocks by bumping an offset. the most recent allocation
+// can grow or be given back in place, and everything is released at once by a reset
+#define STRING_ARENA_BLOCK 65536
+
+typedef struct String_ArenaBlock {
+	struct String_ArenaBlock * next;
+	size_t used;
+	size_t size;
+	uint64_t data[];
+} String_ArenaBlock;
+
+struct String_Arena {
+	String_Allocator allocator; // ctx is the arena
+	String_ArenaBlock * blocks; // the current block first
+	size_t block_size;
+	char * last; // the most recent allocation
+};
+
+static inline size_t String_Arena_round(size_t n) {
+	return (n + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+}
+static void * String_Arena_alloc(void * ctx, size_t n) {
+	String_Arena * arena = ctx;
+	n = String_Arena_round(n);
+	String_ArenaBlock * block = arena->blocks;
+	if (!block || block->size - block->used < n) {
+		size_t size = n > arena->block_size / 4 ? n : arena->block_size;
+		String_ArenaBlock * fresh = malloc(sizeof(*fresh) + size);
+		if (!fresh) {
+			return NULL;
+		}
+		fresh->used = 0;
+		fresh->size = size;
+		if (block && size != arena->block_size) { // an oversized allocation gets a block to itself
+			fresh->next = block->next;
+			block->next = fresh;
+			fresh->used = n;
+			return fresh->data;
+		}
+		fresh->next = block;
+		arena->blocks = fresh;
+		block = fresh;
+	}
+	arena->last = (char *)block->data + block->used;
+	block->used += n;
+	return arena->last;
+}
+// the most recent allocation grows or shrinks in place if the block has room. others are copied
+static void * String_Arena_realloc(void * ctx, void * p, size_t old_size, size_t size) {
+	String_Arena * arena = ctx;
+	if (p && p == arena->last) {
+		size_t offset = (size_t)(arena->last - (char *)arena->blocks->data);
+		if (arena->blocks->size - offset >= String_Arena_round(size)) {
+			arena->blocks->used = offset + String_Arena_round(size);
+			return p;
+		}
+	}
+	void * moved = String_Arena_alloc(arena, size);
+	if (moved && p) {
+		memcpy(moved, p, old_size < size ? old_size : size);
+	}
+	return moved;
+}
+// only the most recent allocation is given back
+static void String_Arena_free(void * ctx, void * p, size_t size) {
+	String_Arena * arena = ctx;
+	if (p && p == arena->last) {
+		arena->blocks->used = (size_t)(arena->last - (char *)arena->blocks->data);
+		arena->last = NULL;
+	}
+}
+
+String_Arena * String_Arena_new(size_t block_size) {
+	String_Arena * arena = calloc(1, sizeof(*arena));
+	if (arena) {
+		arena->allocator = (String_Allocator) {
+			.alloc = String_Arena_alloc,
+			.realloc = String_Arena_realloc,
+			.free = String_Arena_free,
+			.ctx = arena,
+		};
+		arena->block_size = block_size ? block_size : STRING_ARENA_BLOCK;
+	}
+	return arena;
+}
+void String_Arena_reset(String_Arena * arena) {
+	// keep the current block for reuse
+	String_ArenaBlock * block = arena->blocks;
+	if (block) {
+		while (block->next) {
+			String_ArenaBlock * next = block->next->next;
+			free(block->next);
+			block->next = next;
+		}
+		block->used = 0;
+	}
+	arena->last = NULL;
+}
+void String_Arena_del(String_Arena * arena) {
+	if (arena) {
+		String_Arena_reset(arena);
+		free(arena->blocks);
+		free(arena);
+	}
+}
+String_Allocator const * String_Arena_allocator(String_Arena * arena) {
+	return &arena->allocator;
+}
+String_Arena * String_Arena_use(String_Arena * arena) {
+	String_Allocator const * previous = String_Allocator_use(arena ? &arena->allocator : NULL);
+	// an arena's allocator is its first member
+	return previous && previous->alloc == String_Arena_alloc ? (String_Arena *)previous : NULL;
+}
+
+// buffers from malloc are plain malloc'd memory, as are those of Strings filled in by hand, and are
+// grown with realloc and given back with free. a buffer from any other allocator is preceded by a 
+// header naming it, and the capacity field of its String holds STRING_ALLOCATOR_FLAG
+typedef struct String_Header {
+	String_Allocator const * allocator;
+} String_Header;
+
+// the first String_share of a buffer moves its ownership to a control block from the same allocator.
+// the Strings sharing it point 'str_' at their own bytes and hold STRING_SHARED_FLAG and the address
+// of the control block, divided by its alignment, in 'capacity'
+typedef struct String_Shared {
+	char * buffer;
+	size_t capacity; // the capacity field of the buffer's owner before the first share
+	ptrdiff_t refs;
+} String_Shared;
+#define STRING_SHARED_ALIGN 4
+
+static inline String_Shared * String_shared(String const * str) {
+	return (String_Shared *)(uintptr_t)((str->capacity & ~STRING_SHARED_FLAG) * STRING_SHARED_ALIGN);
+}
+
+static inline String_Header * String_header(void * buf) {
+	return (String_Header *)buf - 1;
+}
+// the capacity field of a buffer of 'capacity' chars from 'allocator'
+static inline size_t String_mem_tag(String_Allocator const * allocator, size_t capacity) {
+	return allocator == &String_malloc_allocator ? capacity : capacity | STRING_ALLOCATOR_FLAG;
+}
+// the allocator of the heap buffer 'buf' with the capacity field 'capacity'
+static inline String_Allocator const * String_mem_allocator(void * buf, size_t capacity) {
+	return capacity & STRING_ALLOCATOR_FLAG ? String_header(buf)->allocator : &String_malloc_allocator;
+}
+static void * String_mem_alloc(String_Allocator const * allocator, size_t size) {
+	if (allocator == &String_malloc_allocator) {
+		return malloc(size);
+	}
+	String_Header * header = allocator->alloc(allocator->ctx, sizeof(String_Header) + size);
+	if (!header) {
+		return NULL;
+	}
+	header->allocator = allocator;
+	return header + 1;
+}
+// 'capacity' is the capacity field of 'buf', which keeps its flag at the new size. returns the moved
+// block or NULL, in which case 'buf' is unchanged
+static void * String_mem_realloc(void * buf, size_t capacity, size_t size) {
+	if (!(capacity & STRING_ALLOCATOR_FLAG)) {
+		return realloc(buf, size);
+	}
+	size_t old_size = capacity & ~STRING_ALLOCATOR_FLAG;
+	String_Header * header = String_header(buf);
+	String_Allocator const * allocator = header->allocator;
+	if (!allocator->realloc) {
+		void * moved = String_mem_alloc(allocator, size);
+		if (moved) {
+			memcpy(moved, buf, old_size < size ? old_size : size);
+			allocator->free(allocator->ctx, header, sizeof(String_Header) + old_size);
+		}
+		return moved;
+	}
+	header = allocator->realloc(allocator->ctx, header, sizeof(String_Header) + old_size, 
+		sizeof(String_Header) + size);
+	if (!header) {
+		return NULL;
+	}
+	header->allocator = allocator;
+	return header + 1;
+}
+static void String_mem_free(void * buf, size_t capacity) {
+	if (!(capacity & STRING_ALLOCATOR_FLAG)) {
+		free(buf);
+		return;
+	}
+	String_Header * header = String_header(buf);
+	if (header->allocator->free) {
+		header->allocator->free(header->allocator->ctx, header, 
+			sizeof(String_Header) + (capacity & ~STRING_ALLOCATOR_FLAG));
+	}
+}
+// the start of the heap buffer of 'str'
+static inline char * String_buffer(String const * str) {
+	return String_is_shared(str) ? String_shared(str)->buffer : str->str;
+}
+// the allocator new buffers for 'str' should come from
+static inline String_Allocator const * String_allocator_of(String const * str) {
+	if (!str->capacity || String_is_inline(str)) {
+		return String_default_allocator();
+	} else if (String_is_shared(str)) {
+		return String_mem_allocator(String_shared(str)->buffer, String_shared(str)->capacity);
+	}
+	return String_mem_allocator(str->str, str->capacity);
+}
+// the control block comes from the allocator of the buffer
+static void String_shared_free(String_Shared * shared) {
+	String_Allocator const * allocator = String_mem_allocator(shared->buffer, shared->capacity);
+	if (allocator->free) {
+		allocator->free(allocator->ctx, shared, sizeof(*shared));
+	}
+}
+// drops the reference of a shared string. the last one frees the buffer
+static void String_release(String * str) {
+	String_Shared * shared = String_shared(str);
+	if (!STRING_ATOMIC_DEC(&shared->refs)) {
+		char * buf = shared->buffer;
+		size_t capacity = shared->capacity;
+		String_shared_free(shared);
+		String_mem_free(buf, capacity);
+	}
+}
+
+void String_dest(String * str) {
+	// frees buffer only and resets. To use reallocatable method
+	if (str->capacity) {
+		if (String_is_shared(str)) {
+			String_release(str);
+		} else if (!String_is_inline(str)) {
+			String_mem_free(str->str, str->capacity);
+		}
+		memset(str, 0, sizeof(*str));
+	}
+}
+
+void String_del(String * str) { 
+	// calls *_dest and then frees str
+	String_dest(str);
+	free(str);
+}
+// byte c of a String_CharSet is bit (c >> 4) & 7 of bits[(c >> 7) << 4 | (c & 15)]. the two halves of
+// the bitmap are then the nibble tables the SIMD kernels look up with pshufb
+String_CharSet const WHITESPACE_SET = {
+	.bits = {[' ' & 15] = 1 << (' ' >> 4), ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1}
+};
+
+void String_CharSet_init(String_CharSet * set, String const * chars) {
+	memset(set, 0, sizeof(*set));
+	char const * chars_ = String_data(chars);
+	for (ptrdiff_t i = 0, n = String_len(chars); i < n; i++) {
+		unsigned char c = (unsigned char)chars_[i];
+		set->bits[(c >> 7) << 4 | (c & 15)] |= 1 << ((c >> 4) & 7);
+	}
+}
+
+// span kernels return the index of the first byte whose membership in 'set' differs from 'accept'
+// or n. rspan kernels return the index after the last such byte or 0
+typedef ptrdiff_t (*String_SpanKernel)(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept);
+
+static ptrdiff_t String_span_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept);
+static ptrdiff_t String_rspan_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept);
+
+static String_SpanKernel String_span_kernel = String_span_resolve;
+static String_SpanKernel String_rspan_kernel = String_rspan_resolve;
+
+static ptrdiff_t String_span_scalar(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	ptrdiff_t i = 0;
+	while (i < n && String_CharSet_has(set, s[i]) == accept) {
+		i++;
+	}
+	return i;
+}
+static ptrdiff_t String_rspan_scalar(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	while (n > 0 && String_CharSet_has(set, s[n - 1]) == accept) {
+		n--;
+	}
+	return n;
+}
+
+#ifdef STRING_X86
+
+// 0xFF in each lane of x that is a member of the set given by its nibble tables lo and hi
+__attribute__((target("ssse3")))
+static inline __m128i String_charset_match_ssse3(__m128i lo, __m128i hi, __m128i x) {
+	__m128i const bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	// pshufb yields 0 for indices with the top bit set, which selects between the two tables
+	__m128i idx = _mm_and_si128(x, _mm_set1_epi8((char)0x8F));
+	__m128i row = _mm_or_si128(_mm_shuffle_epi8(lo, idx), 
+		_mm_shuffle_epi8(hi, _mm_xor_si128(idx, _mm_set1_epi8((char)0x80))));
+	__m128i col = _mm_shuffle_epi8(bit, _mm_and_si128(_mm_srli_epi16(x, 4), _mm_set1_epi8(0x0F)));
+	return _mm_cmpeq_epi8(_mm_and_si128(row, col), col);
+}
+
+__attribute__((target("ssse3")))
+static ptrdiff_t String_span_ssse3(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	__m128i const lo = _mm_loadu_si128((__m128i const *)set->bits);
+	__m128i const hi = _mm_loadu_si128((__m128i const *)(set->bits + 16));
+	unsigned const flip = accept ? 0xFFFF : 0;
+	ptrdiff_t i = 0;
+	for ( ; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(s + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(String_charset_match_ssse3(lo, hi, x)) ^ flip;
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + String_span_scalar(set, s + i, n - i, accept);
+}
+__attribute__((target("ssse3")))
+static ptrdiff_t String_rspan_ssse3(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	__m128i const lo = _mm_loadu_si128((__m128i const *)set->bits);
+	__m128i const hi = _mm_loadu_si128((__m128i const *)(set->bits + 16));
+	unsigned const flip = accept ? 0xFFFF : 0;
+	for ( ; n >= 16; n -= 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(s + n - 16));
+		unsigned mask = (unsigned)_mm_movemask_epi8(String_charset_match_ssse3(lo, hi, x)) ^ flip;
+		if (mask) {
+			return n - 16 + (32 - __builtin_clz(mask));
+		}
+	}
+	return String_rspan_scalar(set, s, n, accept);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i String_charset_match_avx2(__m256i lo, __m256i hi, __m256i x) {
+	__m256i const bit = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+		1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	__m256i idx = _mm256_and_si256(x, _mm256_set1_epi8((char)0x8F));
+	__m256i row = _mm256_or_si256(_mm256_shuffle_epi8(lo, idx), 
+		_mm256_shuffle_epi8(hi, _mm256_xor_si256(idx, _mm256_set1_epi8((char)0x80))));
+	__m256i col = _mm256_shuffle_epi8(bit, 
+		_mm256_and_si256(_mm256_srli_epi16(x, 4), _mm256_set1_epi8(0x0F)));
+	return _mm256_cmpeq_epi8(_mm256_and_si256(row, col), col);
+}
+
+__attribute__((target("avx2")))
+static ptrdiff_t String_span_avx2(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	// vpshufb looks up within each 128-bit lane, so both lanes get a copy of the tables
+	__m256i const lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)set->bits));
+	__m256i const hi = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((__m128i const *)(set->bits + 16)));
+	unsigned const flip = accept ? 0xFFFFFFFF : 0;
+	ptrdiff_t i = 0;
+	for ( ; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(s + i));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(String_charset_match_avx2(lo, hi, x)) ^ flip;
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + String_span_ssse3(set, s + i, n - i, accept);
+}
+__attribute__((target("avx2")))
+static ptrdiff_t String_rspan_avx2(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	__m256i const lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)set->bits));
+	__m256i const hi = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((__m128i const *)(set->bits + 16)));
+	unsigned const flip = accept ? 0xFFFFFFFF : 0;
+	for ( ; n >= 32; n -= 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(s + n - 32));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(String_charset_match_avx2(lo, hi, x)) ^ flip;
+		if (mask) {
+			return n - 32 + (32 - __builtin_clz(mask));
+		}
+	}
+	return String_rspan_ssse3(set, s, n, accept);
+}
+
+#endif // STRING_X86
+
+// kernels specialized for WHITESPACE_SET, which is a space or a byte in '\t'...'\r'. they share the
+// signature of the span kernels but ignore the set
+static ptrdiff_t String_ws_span_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept);
+static ptrdiff_t String_ws_rspan_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept);
+
+static String_SpanKernel String_ws_span_kernel = String_ws_span_resolve;
+static String_SpanKernel String_ws_rspan_kernel = String_ws_rspan_resolve;
+
+#ifdef STRING_X86
+
+// 0xFF in each whitespace lane of x
+__attribute__((target("sse2")))
+static inline __m128i String_ws_match_sse2(__m128i x) {
+	__m128i ctl = _mm_sub_epi8(x, _mm_set1_epi8('\t')); // '\t'...'\r' map to 0...4
+	return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), 
+		_mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8('\r' - '\t')), ctl));
+}
+
+__attribute__((target("sse2")))
+static ptrdiff_t String_ws_span_sse2(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	unsigned const flip = accept ? 0xFFFF : 0;
+	ptrdiff_t i = 0;
+	for ( ; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(s + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(String_ws_match_sse2(x)) ^ flip;
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + String_span_scalar(&WHITESPACE_SET, s + i, n - i, accept);
+}
+__attribute__((target("sse2")))
+static ptrdiff_t String_ws_rspan_sse2(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	unsigned const flip = accept ? 0xFFFF : 0;
+	for ( ; n >= 16; n -= 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(s + n - 16));
+		unsigned mask = (unsigned)_mm_movemask_epi8(String_ws_match_sse2(x)) ^ flip;
+		if (mask) {
+			return n - 16 + (32 - __builtin_clz(mask));
+		}
+	}
+	return String_rspan_scalar(&WHITESPACE_SET, s, n, accept);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i String_ws_match_avx2(__m256i x) {
+	__m256i ctl = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+	return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), 
+		_mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8('\r' - '\t')), ctl));
+}
+
+__attribute__((target("avx2")))
+static ptrdiff_t String_ws_span_avx2(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	unsigned const flip = accept ? 0xFFFFFFFF : 0;
+	ptrdiff_t i = 0;
+	for ( ; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(s + i));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(String_ws_match_avx2(x)) ^ flip;
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + String_ws_span_sse2(set, s + i, n - i, accept);
+}
+__attribute__((target("avx2")))
+static ptrdiff_t String_ws_rspan_avx2(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	unsigned const flip = accept ? 0xFFFFFFFF : 0;
+	for ( ; n >= 32; n -= 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(s + n - 32));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(String_ws_match_avx2(x)) ^ flip;
+		if (mask) {
+			return n - 32 + (32 - __builtin_clz(mask));
+		}
+	}
+	return String_ws_rspan_sse2(set, s, n, accept);
+}
+
+#endif // STRING_X86
+
+ptrdiff_t String_span(String const * str, String_CharSet const * set) {
+	String_SpanKernel kernel = set == &WHITESPACE_SET ? String_ws_span_kernel : String_span_kernel;
+	return String_len(str) > 0 ? kernel(set, String_data(str), String_len(str), true) : 0;
+}
+ptrdiff_t String_cspan(String const * str, String_CharSet const * set) {
+	String_SpanKernel kernel = set == &WHITESPACE_SET ? String_ws_span_kernel : String_span_kernel;
+	return String_len(str) > 0 ? kernel(set, String_data(str), String_len(str), false) : 0;
+}
+ptrdiff_t String_rspan(String const * str, String_CharSet const * set) {
+	String_SpanKernel kernel = set == &WHITESPACE_SET ? String_ws_rspan_kernel : String_rspan_kernel;
+	return String_len(str) > 0 ? String_len(str) - kernel(set, String_data(str), String_len(str), true) : 0;
+}
+
+// translate kernels map each byte of src[:n] through 'table', dropping those in 'drop' (if not
+// NULL), and return the number of bytes written to dst. dst may be src since writes never overtake
+// reads
+typedef ptrdiff_t (*String_TranslateKernel)(unsigned char const * table, String_CharSet const * drop,
+	char * dst, char const * src, ptrdiff_t n);
+
+static ptrdiff_t String_translate_resolve(unsigned char const * table, String_CharSet const * drop,
+	char * dst, char const * src, ptrdiff_t n);
+
+static String_TranslateKernel String_translate_kernel = String_translate_resolve;
+
+static ptrdiff_t String_translate_scalar(unsigned char const * table, String_CharSet const * drop,
+	char * dst, char const * src, ptrdiff_t n) {
+
+	ptrdiff_t w = 0;
+	if (drop) {
+		for (ptrdiff_t i = 0; i < n; i++) {
+			if (!String_CharSet_has(drop, src[i])) {
+				dst[w++] = (char)table[(unsigned char)src[i]];
+			}
+		}
+	} else {
+		for ( ; w < n; w++) {
+			dst[w] = (char)table[(unsigned char)src[w]];
+		}
+	}
+	return w;
+}
+
+#ifdef STRING_X86
+
+// writes the high nibbles of the 16-byte rows of 'table' that are not the identity to 'rows'
+static int String_translate_rows(unsigned char const * table, unsigned char * rows) {
+	int nrows = 0;
+	for (int h = 0; h < 16; h++) {
+		if (memcmp(table + 16 * h, String_identity_table + 16 * h, 16)) {
+			rows[nrows++] = (unsigned char)h;
+		}
+	}
+	return nrows;
+}
+
+// bytes are looked up with pshufb in the rows of the table that are not the identity, selected by
+// the high nibble. a block with a byte to drop is compacted with scalar code
+__attribute__((target("ssse3")))
+static ptrdiff_t String_translate_ssse3(unsigned char const * table, String_CharSet const * drop,
+	char * dst, char const * src, ptrdiff_t n) {
+
+	unsigned char hs[16];
+	__m128i rows[16];
+	int nrows = String_translate_rows(table, hs);
+	for (int r = 0; r < nrows; r++) {
+		rows[r] = _mm_loadu_si128((__m128i const *)(table + 16 * hs[r]));
+	}
+	__m128i const lo = drop ? _mm_loadu_si128((__m128i const *)drop->bits) : _mm_setzero_si128();
+	__m128i const hi = drop ? _mm_loadu_si128((__m128i const *)(drop->bits + 16)) : lo;
+	__m128i const nibble = _mm_set1_epi8(0x0F);
+	ptrdiff_t i = 0;
+	ptrdiff_t w = 0;
+	for ( ; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((__m128i const *)(src + i));
+		__m128i idx = _mm_and_si128(x, nibble);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+		__m128i y = x;
+		for (int r = 0; r < nrows; r++) {
+			__m128i m = _mm_cmpeq_epi8(high, _mm_set1_epi8((char)hs[r]));
+			y = _mm_or_si128(_mm_andnot_si128(m, y), _mm_and_si128(m, _mm_shuffle_epi8(rows[r], idx)));
+		}
+		unsigned mask = drop ? (unsigned)_mm_movemask_epi8(String_charset_match_ssse3(lo, hi, x)) : 0;
+		if (!mask) {
+			_mm_storeu_si128((__m128i *)(dst + w), y);
+			w += 16;
+		} else {
+			char out[16];
+			_mm_storeu_si128((__m128i *)out, y);
+			for (int j = 0; j < 16; j++) {
+				if (!(mask >> j & 1)) {
+					dst[w++] = out[j];
 				}
-			} else {
-				str_ = malloc(capacity * sizeof(char));
 			}
-			str->str = str_;
-		}
-	} else { // a buffer was not provided
-		if (capacity) { // resize the capacity of the underlying buffer
-			char * str_ = realloc(str->str, sizeof(char) * capacity);
-			if (!str_) { 
-				free(str->str);
-				*str = (String) {0};
+		}
+	}
+	return w + String_translate_scalar(table, drop, dst + w, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static ptrdiff_t String_translate_avx2(unsigned char const * table, String_CharSet const * drop,
+	char * dst, char const * src, ptrdiff_t n) {
+
+	unsigned char hs[16];
+	__m256i rows[16];
+	int nrows = String_translate_rows(table, hs);
+	for (int r = 0; r < nrows; r++) {
+		rows[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)(table + 16 * hs[r])));
+	}
+	__m256i const lo = drop ? 
+		_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)drop->bits)) : 
+		_mm256_setzero_si256();
+	__m256i const hi = drop ? 
+		_mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)(drop->bits + 16))) : lo;
+	__m256i const nibble = _mm256_set1_epi8(0x0F);
+	ptrdiff_t i = 0;
+	ptrdiff_t w = 0;
+	for ( ; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((__m256i const *)(src + i));
+		__m256i idx = _mm256_and_si256(x, nibble);
+		__m256i high = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+		__m256i y = x;
+		for (int r = 0; r < nrows; r++) {
+			__m256i m = _mm256_cmpeq_epi8(high, _mm256_set1_epi8((char)hs[r]));
+			y = _mm256_blendv_epi8(y, _mm256_shuffle_epi8(rows[r], idx), m);
+		}
+		unsigned mask = drop ? 
+			(unsigned)_mm256_movemask_epi8(String_charset_match_avx2(lo, hi, x)) : 0;
+		if (!mask) {
+			_mm256_storeu_si256((__m256i *)(dst + w), y);
+			w += 32;
+		} else {
+			char out[32];
+			_mm256_storeu_si256((__m256i *)out, y);
+			for (int j = 0; j < 32; j++) {
+				if (!(mask >> j & 1)) {
+					dst[w++] = out[j];
+				}
+			}
+		}
+	}
+	return w + String_translate_ssse3(table, drop, dst + w, src + i, n - i);
+}
+
+#endif // STRING_X86
+
+void String_strip_set(String * str, String_CharSet const * set) {
+	// run rstrip first so that the potential move in lstrip is moving less memory
+	String_rstrip_set(str, set);
+	String_lstrip_set(str, set);
+}
+void String_lstrip_set(String * str, String_CharSet const * set) {
+	ptrdiff_t itest = String_span(str, set);
+	if (itest) {
+		String_set_len(str, String_len(str) - itest);
+		// borrowed and shared bytes stay put and the string starts later in them
+		if (!str->capacity || String_is_shared(str)) {
+			str->str += itest;
+			return;
+		}
+		memmove(String_data(str), String_data(str) + itest, String_len(str) * sizeof(char));
+	}
+}
+void String_rstrip_set(String * str, String_CharSet const * set) {
+	String_set_len(str, String_len(str) - String_rspan(str, set));
+}
+// the set to strip for 'chars' (whitespace if NULL). 'buf' holds the set if it has to be built
+static String_CharSet const * String_strip_chars(String const * chars, String_CharSet * buf) {
+	if (chars == NULL) {
+		return &WHITESPACE_SET;
+	}
+	String_CharSet_init(buf, chars);
+	return buf;
+}
+void String_strip(String * str, String const * restrict chars) {
+	// whitespace if chars == NULL
+	String_CharSet buf;
+	String_strip_set(str, String_strip_chars(chars, &buf));
+}
+void String_lstrip(String * str, String const * restrict chars) {
+	// whitespace if chars == NULL
+	String_CharSet buf;
+	String_lstrip_set(str, String_strip_chars(chars, &buf));
+}
+void String_rstrip(String * str, String const * restrict chars) {
+	// whitespace if chars == NULL
+	String_CharSet buf;
+	String_rstrip_set(str, String_strip_chars(chars, &buf));
+}
+
+// can fail if target string does not have large enough size or will reallocate underlying
+// buffer. failures are negative returns or null strings
+
+// gives 'str', which must not own its buffer, one of 'capacity' chars from 'allocator'. it is kept
+// inline if it fits, unless a specific allocator was asked for: an inline string has no header, so it
+// spills to the default allocator. the contents of a view are kept up to 'capacity'. returns false on 
+// allocation failure
+static _Bool String_own(String_Allocator const * allocator, String * str, size_t capacity) {
+	size_t keep = String_len(str) > 0 ? (size_t)String_len(str) : 0;
+	if (keep > capacity) {
+		keep = capacity;
+	}
+	if (capacity <= STRING_SSO_CAPACITY && allocator == String_default_allocator()) {
+		char inline_[sizeof(String)];
+		if (keep) {
+			memcpy(inline_, str->str, keep);
+		}
+		str->capacity = STRING_SSO_FLAG | keep << STRING_SSO_SHIFT;
+		memcpy(String_data(str), inline_, keep);
+		return true;
+	}
+	char * str_ = capacity <= STRING_CAPACITY_MAX ? String_mem_alloc(allocator, capacity) : NULL;
+	if (!str_) {
+		return false;
+	}
+	if (keep) {
+		memcpy(str_, str->str, keep);
+	}
+	str->str = str_;
+	str->capacity = String_mem_tag(allocator, capacity);
+	return true;
+}
+
+// internal function. resizes without clearing (as opposed to String_init(., ., 0, 0). a string 
+// that does not own its buffer gets one with a copy of its contents, as does a shared string. inline
+// strings spill to the heap when they outgrow STRING_SSO_CAPACITY but heap buffers are never moved
+// back inline
+String * String_resize(String * str, size_t new_capacity) {
+	if (String_is_shared(str) && STRING_ATOMIC_LOAD(&String_shared(str)->refs) == 1) {
+		String_unshare(str); // the last owner takes the buffer back
+	}
+	if (new_capacity > STRING_CAPACITY_MAX) {
+		return NULL;
+	} else if (String_is_inline(str)) {
+		if (new_capacity <= STRING_SSO_CAPACITY) {
+			return str;
+		}
+		String_Allocator const * allocator = String_default_allocator();
+		char * str_ = String_mem_alloc(allocator, new_capacity);
+		if (!str_) {
+			return NULL;
+		}
+		ptrdiff_t size = String_len(str);
+		memcpy(str_, String_data(str), size);
+		str->str = str_;
+		str->size = size;
+		str->capacity = String_mem_tag(allocator, new_capacity);
+	} else if (String_is_shared(str)) {
+		// copy out as if from a view and leave the buffer to the other owners
+		String shared = *str;
+		str->capacity = 0;
+		if (!String_own(String_allocator_of(&shared), str, new_capacity)) {
+			*str = shared;
+			return NULL;
+		}
+		String_release(&shared);
+	} else if (str->capacity) {
+		char * str_ = String_mem_realloc(str->str, str->capacity, new_capacity);
+		if (!str_) {
+			return NULL;
+		}
+		str->str = str_;
+		str->capacity = (str->capacity & STRING_ALLOCATOR_FLAG) | new_capacity;
+	} else if (!String_own(String_default_allocator(), str, new_capacity)) {
+		return NULL;
+	}
+	return str;
+}
+
+static int String_unshare(String * str) {
+	if (!str->capacity && String_len(str) > 0) { // borrowed bytes must not be written through the view
+		return String_resize(str, (size_t)String_len(str)) ? 0 : -1;
+	} else if (!String_is_shared(str)) {
+		return 0;
+	}
+	String_Shared * shared = String_shared(str);
+	if (STRING_ATOMIC_LOAD(&shared->refs) == 1) { // the other owners are gone: take the buffer back
+		memmove(shared->buffer, str->str, String_len(str));
+		str->str = shared->buffer;
+		str->capacity = shared->capacity;
+		String_shared_free(shared);
+		return 0;
+	}
+	return String_resize(str, String_len(str) > 0 ? (size_t)String_len(str) : 1) ? 0 : -1;
+}
+
+// internal function behind the String_init family. a non-zero size makes a fresh string (forgetting
+// any previous buffer) unless a capacity is also given, which an owned buffer grows to. size 0 with a
+// capacity resizes the buffer, keeping the contents of a view, and with neither releases it
+static void String_init_(String_Allocator const * allocator, String * restrict str, 
+	char const * restrict buf, 
+	ptrdiff_t size, size_t capacity) {
+
+	if (!size && !capacity) {
+		if (str->capacity) {
+			String_dest(str);
+		} else if (buf && str->str) {
+			String_set_len(str, 0);
+		}
+		return;
+	}
+	_Bool fresh = size && !capacity;
+	if (fresh || capacity < (size_t)size) {
+		capacity = (size_t)size == SIZE_MAX ? (size_t)size : (size_t)size + 1;
+	}
+	if (fresh) {
+		*str = (String) {0};
+	}
+	_Bool ok = true;
+	if (!str->capacity) {
+		ok = String_own(allocator, str, capacity);
+	} else if (!size || String_capacity(str) < capacity) { // size 0 resizes exactly, possibly shrinking
+		ok = String_resize(str, capacity) != NULL;
+	}
+	if (!ok) {
+		String_dest(str);
+		*str = (String) {0};
+		return;
+	}
+	char * str_ = String_data(str);
+	if (buf) {
+		memcpy(str_, buf, size * sizeof(char));
+		String_set_len(str, size);
+	}
+	if (fresh && !buf) {
+		memset(str_, 0, capacity);
+	} else if (fresh && (size_t)size < capacity) {
+		str_[size] = '\0';
+	}
+}
+void String_init(String * restrict str, char const * restrict buf, ptrdiff_t size, size_t capacity) {
+	String_init_(String_default_allocator(), str, buf, size, capacity);
+}
+void String_init_with(String * restrict str, String_Allocator const * allocator, 
+	char const * restrict buf, ptrdiff_t size, size_t capacity) {
+
+	String_init_(allocator ? allocator : String_default_allocator(), str, buf, size, capacity);
+}
+void String_init_arena(String * restrict str, String_Arena * arena, char const * restrict buf, 
+	ptrdiff_t size, size_t capacity) {
+
+	String_init_with(str, arena ? &arena->allocator : &String_malloc_allocator, buf, size, capacity);
+}
+// the growth policy of every operation that appends: grows to STRING_GROWTH_FACTOR times the current
+// capacity, or to 'need' if that is more, so that repeated appends copy O(n) bytes in total. views 
+// get a fresh buffer with a copy of their contents. sizes beyond PTRDIFF_MAX fail
+static int String_reserve_geometric(String * str, size_t need) {
+	size_t capacity = String_capacity(str);
+	if (need <= capacity && (str->capacity || !need)) {
+		return 0;
+	} else if (need > PTRDIFF_MAX) {
+		return -1;
+	}
+	capacity = capacity <= PTRDIFF_MAX / STRING_GROWTH_FACTOR ? 
+		(size_t)(STRING_GROWTH_FACTOR * capacity) : PTRDIFF_MAX;
+	if (capacity < need) {
+		capacity = need;
+	}
+	return String_resize(str, capacity) ? 0 : -1;
+}
+int String_reserve(String * str, size_t capacity) {
+	if (capacity <= String_capacity(str) && (str->capacity || !capacity)) {
+		return 0;
+	} else if (capacity > PTRDIFF_MAX) {
+		return -1;
+	}
+	return String_resize(str, capacity) ? 0 : -1;
+}
+int String_shrink_to_fit(String * str) {
+	size_t size = String_len(str) > 0 ? (size_t)String_len(str) : 0;
+	if (!str->capacity || String_is_inline(str) || 
+		(!String_is_shared(str) && size == String_capacity(str))) {
+
+		return 0;
+	}
+	if (size <= STRING_SSO_CAPACITY && !String_is_shared(str) && 
+		String_allocator_of(str) == String_default_allocator()) {
+		// move back inline: treat the heap buffer as a view while copying out of it
+		char * buf = str->str;
+		size_t capacity = str->capacity;
+		str->capacity = 0;
+		String_own(String_default_allocator(), str, size);
+		String_mem_free(buf, capacity);
+		return 0;
+	}
+	return String_resize(str, size ? size : 1) ? 0 : -1;
+}
+void String_partition(String * str, String const * sep, String * restrict suffix) {
+	ptrdiff_t i = String_find(str, sep, 0, 0);
+	if (i < 0) {
+		String_init(suffix, NULL, 0, 0);
+		return;
+	}
+	String_init(suffix, String_data(str) + i + String_len(sep), String_len(str) - i - String_len(sep), 0);
+	String_set_len(str, i);
+}
+void String_rpartition(String * str, String const * sep, String * restrict suffix) {
+	ptrdiff_t i = String_rfind(str, sep, 0, 0);
+	if (i < 0) {
+		String_init(suffix, NULL, 0, 0);
+		return;
+	}
+	String_init(suffix, String_data(str) + i + String_len(sep), String_len(str) - i - String_len(sep), 0);
+	String_set_len(str, i);
+}
+void String_copy(String * restrict dest, String const * restrict src) {
+	String_init(dest, String_data(src), String_len(src), 0);
+}
+int String_share(String * restrict dest, String * restrict src) {
+	if (!src->capacity || String_is_inline(src)) {
+		*dest = (String) {0};
+		if (String_len(src) > 0) {
+			String_init(dest, String_data(src), String_len(src), 0);
+		}
+		return String_len(src) > 0 && !dest->capacity ? -1 : 0;
+	}
+	if (!String_is_shared(src)) { // the first share: a control block takes over the buffer
+		String_Allocator const * allocator = String_allocator_of(src);
+		String_Shared * shared = allocator->alloc(allocator->ctx, sizeof(*shared));
+		if (!shared) {
+			*dest = (String) {0};
+			return -1;
+		}
+		*shared = (String_Shared) {.buffer = src->str, .capacity = src->capacity, .refs = 1};
+		src->capacity = STRING_SHARED_FLAG | (uintptr_t)shared / STRING_SHARED_ALIGN;
+	}
+	STRING_ATOMIC_ADD(&String_shared(src)->refs, 1);
+	*dest = *src;
+	return 0;
+}
+int String_share_slice(String * restrict dest, String * restrict src, ptrdiff_t start, 
+	ptrdiff_t end) {
+
+	if (String_len(src) <= 0 || !String_range(src, &start, &end)) {
+		*dest = (String) {0};
+		return 0;
+	} else if (!src->capacity || String_is_inline(src)) {
+		*dest = (String) {0};
+		String_init(dest, String_data(src) + start, end - start, 0);
+		return dest->capacity ? 0 : -1;
+	}
+	if (String_share(dest, src)) {
+		return -1;
+	}
+	dest->str += start;
+	String_set_len(dest, end - start);
+	return 0;
+}
+int String_expand_tabs(String * str, unsigned char tabsize) {
+	ptrdiff_t N = String_len(str);
+	if (N <= 0) {
+		return 0;
+	}
+	ptrdiff_t new_size = N;
+	char * str_ = String_data(str);
+	int ntab = 0;
+	for (ptrdiff_t i = 0; i < N; i++) {
+		if (str_[i] == '\t') {
+			if (new_size > PTRDIFF_MAX - tabsize) {
+				return -1;
+			}
+			new_size += tabsize - 1;
+			ntab++;
+		}
+	}
+	if (!ntab) {
+		return 0;
+	} else if (String_reserve_geometric(str, new_size)) {
+		return -1;
+	}
+	// at this point, the str has sufficient capacity
+	String_set_len(str, new_size);
+	new_size--; // new_size is now the write pointer while N is the read
+	str_ = String_data(str); // reset in case realloc'd
+	N--;
+	while (N > -1) {
+		if (str_[N] == '\t') {
+			for (unsigned char i = 0; i < tabsize; i++) {
+				str_[new_size--] = ' ';
+			}
+		} else {
+			str_[new_size--] = str_[N];
+		}
+		N--;
+	}
+	return ntab;
+}
+int String_append(String * str, char chr) {
+	if (String_len(str) < 0 || String_reserve_geometric(str, (size_t)String_len(str) + 1)) {
+		return -1;
+	}
+	// at this point, str has sufficient capacity
+	String_data(str)[String_len(str)] = chr;
+	String_set_len(str, String_len(str) + 1);
+	return 0;
+}
+int String_extend(String * restrict str, String const * restrict other) {
+	if (String_len(str) < 0 || String_len(other) < 0 || 
+		String_reserve_geometric(str, (size_t)String_len(str) + (size_t)String_len(other))) {
+		
+		return -1;
+	}
+	// at this point, str has sufficient capacity
+	if (String_len(other)) {
+		memcpy(String_data(str) + String_len(str), String_data(other), String_len(other) * sizeof(char));
+	}
+	String_set_len(str, String_len(str) + String_len(other));
+	return 0;
+}
+
+// TODO: here
+
+// streams 'src' into 'dest' with at most 'limit' matches of tw replaced by 'new'. dest is appended to
+static ptrdiff_t String_replace_tw(String * restrict dest, char const * restrict src, ptrdiff_t size, 
+	String_TwoWay const * tw, String const * restrict new, ptrdiff_t limit) {
+
+	ptrdiff_t locs[STRING_FIND_CHUNK];
+	ptrdiff_t nrep = 0;
+	ptrdiff_t read = 0;
+	ptrdiff_t nlocs = STRING_FIND_CHUNK;
+	while (nlocs == STRING_FIND_CHUNK && nrep < limit) {
+		ptrdiff_t n = limit - nrep < STRING_FIND_CHUNK ? limit - nrep : STRING_FIND_CHUNK;
+		nlocs = String_find_all_tw(tw, src + read, size - read, false, locs, n);
+		ptrdiff_t base = read;
+		for (ptrdiff_t i = 0; i < nlocs; i++) {
+			ptrdiff_t keep = base + locs[i] - read;
+			if (String_reserve_geometric(dest, (size_t)String_len(dest) + keep + String_len(new))) {
+				return -1;
+			}
+			// an empty dest may still have no buffer
+			if (keep) {
+				memcpy(String_data(dest) + String_len(dest), src + read, keep * sizeof(char));
+			}
+			if (String_len(new)) {
+				memcpy(String_data(dest) + String_len(dest) + keep, String_data(new), String_len(new) * sizeof(char));
+			}
+			String_set_len(dest, String_len(dest) + keep + String_len(new));
+			read += keep + tw->size;
+		}
+		nrep += nlocs;
+		if (nlocs < n) {
+			break;
+		}
+	}
+	if (String_reserve_geometric(dest, (size_t)String_len(dest) + (size - read))) {
+		return -1;
+	}
+	if (size > read) {
+		memcpy(String_data(dest) + String_len(dest), src + read, (size - read) * sizeof(char));
+	}
+	String_set_len(dest, String_len(dest) + size - read);
+	return nrep;
+}
+int String_replace_into(String * restrict dest, String const * restrict src, 
+	String const * restrict old, String const * restrict new, int count) {
+	ptrdiff_t size = String_len(src);
+	if (size < 0 || String_len(old) < 0 || String_len(new) < 0) {
+		return -1;
+	}
+	String_set_len(dest, 0);
+	if (!String_len(old)) {
+		if (String_reserve_geometric(dest, size)) {
+			return -1;
+		}
+		if (size) {
+			memcpy(String_data(dest), String_data(src), size * sizeof(char));
+		}
+		String_set_len(dest, size);
+		return 0;
+	}
+	String_TwoWay tw;
+	String_two_way_init(&tw, old);
+	return (int)String_replace_tw(dest, String_data(src), size, &tw, new, count > 0 ? count : PTRDIFF_MAX);
+}
+static int String_case_into(String * restrict dest, String const * restrict src, char first) {
+	ptrdiff_t size = String_len(src);
+	String_set_len(dest, 0);
+	if (size < 0 || String_reserve_geometric(dest, size)) {
+		return -1;
+	}
+	if (size) {
+		STRING_KERNEL(String_case_kernel)(String_data(dest), String_data(src), size, first);
+	}
+	String_set_len(dest, size);
+	return 0;
+}
+int String_lower_into(String * restrict dest, String const * restrict src) {
+	return String_case_into(dest, src, 'A');
+}
+int String_upper_into(String * restrict dest, String const * restrict src) {
+	return String_case_into(dest, src, 'a');
+}
+void String_maketrans(unsigned char * table, String const * from, String const * to) {
+	memcpy(table, String_identity_table, sizeof(String_identity_table));
+	ptrdiff_t n = String_len(from) < String_len(to) ? String_len(from) : String_len(to);
+	for (ptrdiff_t i = 0; i < n; i++) {
+		table[(unsigned char)String_data(from)[i]] = (unsigned char)String_data(to)[i];
+	}
+}
+void String_translate(String * str, unsigned char const * table, String_CharSet const * drop) {
+	if (String_len(str) <= 0 || (!table && !drop) || String_unshare(str)) {
+		return;
+	}
+	String_set_len(str, STRING_KERNEL(String_translate_kernel)(table ? table : String_identity_table, drop, 
+		String_data(str), String_data(str), String_len(str)));
+}
+int String_translate_into(String * restrict dest, String const * restrict src, 
+	unsigned char const * table, String_CharSet const * drop) {
+
+	ptrdiff_t size = String_len(src);
+	if (size < 0) {
+		return -1;
+	}
+	String_set_len(dest, 0);
+	if (String_reserve_geometric(dest, size)) {
+		return -1;
+	}
+	if (size) {
+		String_set_len(dest, STRING_KERNEL(String_translate_kernel)(table ? table : String_identity_table, drop, 
+			String_data(dest), String_data(src), size));
+	}
+	return 0;
+}
+int String_replace(String * str, String const * restrict old, 
+	String const * restrict new, int count) {
+	ptrdiff_t read = String_len(str);
+	ptrdiff_t old_size = String_len(old);
+	ptrdiff_t new_size = String_len(new);
+	if (old_size <= 0 || read <= 0) {
+		return 0;
+	}
+	String_TwoWay tw;
+	String_two_way_init(&tw, old);
+	ptrdiff_t limit = count > 0 ? count : PTRDIFF_MAX;
+	if (new_size > old_size) {
+		if (new_size - old_size > PTRDIFF_MAX - read) {
+			return -1;
+		}
+		// the output grows: stream into a new buffer and take it over. no memmoves and the buffer
+		// only grows geometrically as matches are found
+		String out = {0};
+		String_init_(String_allocator_of(str), &out, NULL, 0, read + new_size - old_size);
+		if (!out.capacity) {
+			return -1;
+		}
+		ptrdiff_t nrep = String_replace_tw(&out, String_data(str), read, &tw, new, limit);
+		if (nrep <= 0) {
+			String_dest(&out);
+			return (int)nrep;
+		}
+		String_dest(str);
+		*str = out;
+		return (int)nrep;
+	}
+	// the output never overtakes the input: compact front to back as matches are found
+	if (!str->capacity || String_is_shared(str)) { // only copy borrowed bytes if they are going to change
+		if (String_find_tw(str, &tw, 0, 0) < 0) {
+			return 0;
+		} else if (String_unshare(str)) {
+			return -1;
+		}
+	}
+	char * str_ = String_data(str);
+	ptrdiff_t locs[STRING_FIND_CHUNK];
+	ptrdiff_t nrep = 0;
+	ptrdiff_t r = 0;
+	ptrdiff_t w = 0;
+	ptrdiff_t nlocs = STRING_FIND_CHUNK;
+	while (nlocs == STRING_FIND_CHUNK && nrep < limit) {
+		ptrdiff_t n = limit - nrep < STRING_FIND_CHUNK ? limit - nrep : STRING_FIND_CHUNK;
+		nlocs = String_find_all_tw(&tw, str_ + r, read - r, false, locs, n);
+		ptrdiff_t base = r;
+		for (ptrdiff_t i = 0; i < nlocs; i++) {
+			ptrdiff_t keep = base + locs[i] - r;
+			if (w != r) {
+				memmove(str_ + w, str_ + r, keep * sizeof(char));
+			}
+			memcpy(str_ + w + keep, String_data(new), new_size * sizeof(char));
+			w += keep + new_size;
+			r += keep + old_size;
+		}
+		nrep += nlocs;
+		if (nlocs < n) {
+			break;
+		}
+	}
+	if (w != r) {
+		memmove(str_ + w, str_ + r, (read - r) * sizeof(char));
+	}
+	String_set_len(str, w + read - r);
+	return (int)nrep;
+}
+
+// allocates upon return
+String * String_new(char const * buf, size_t size, size_t capacity) {
+	String * str = malloc(sizeof(*str));
+	if (!str) {
+		return NULL;
+	}
+	*str = (String){0};
+	String_init(str, buf, size, capacity);
+	return str;
+}
+static ptrdiff_t String_split_tw(ptrdiff_t nsplit, String * restrict dest, String * restrict str, 
+	String_TwoWay const * tw) {
+
+	ptrdiff_t N = String_len(str);
+	ptrdiff_t start = 0;
+	ptrdiff_t j = 0;
+	ptrdiff_t locs[STRING_FIND_CHUNK];
+	ptrdiff_t nlocs = STRING_FIND_CHUNK;
+	while (j < nsplit && nlocs == STRING_FIND_CHUNK) {
+		ptrdiff_t n = nsplit - j < STRING_FIND_CHUNK ? nsplit - j : STRING_FIND_CHUNK;
+		ptrdiff_t offset = start;
+		nlocs = String_find_all_tw(tw, String_data(str) + offset, N - offset, false, locs, n);
+		for (ptrdiff_t i = 0; i < nlocs; i++) {
+			String_init(dest + j++, String_data(str) + start, offset + locs[i] - start, 0);
+			start = offset + locs[i] + tw->size;
+		}
+	}
+	if (j < nsplit && start < N) {
+		String_init(dest + j++, String_data(str) + start, N - start, 0);
+	}
+	return j;
+}
+// runs of whitespace are one separator and leading and trailing whitespace yields no empty strings
+static ptrdiff_t String_split_ws(ptrdiff_t nsplit, String * restrict dest, String * restrict str) {
+	ptrdiff_t N = String_len(str);
+	char const * str_ = String_data(str);
+	ptrdiff_t start = 0;
+	ptrdiff_t j = 0;
+	while (j < nsplit) {
+		start += STRING_KERNEL(String_ws_span_kernel)(&WHITESPACE_SET, str_ + start, N - start, true);
+		if (start >= N) {
+			break;
+		}
+		ptrdiff_t size = STRING_KERNEL(String_ws_span_kernel)(&WHITESPACE_SET, str_ + start, N - start, false);
+		String_init(dest + j++, str_ + start, size, 0);
+		start += size;
+	}
+	return j;
+}
+// separate on whitespace if sep is NULL. Returns number of elements of dest filled
+ptrdiff_t String_split(ptrdiff_t nsplit, String * restrict dest, String * restrict str, String * restrict sep) {
+	if (nsplit < 1) {
+		return -1;
+	}
+	if (!sep) {
+		return String_split_ws(nsplit, dest, str);
+	}
+	if (String_len(sep) <= 0) {
+		return -1;
+	}
+	String_TwoWay tw;
+	String_two_way_init(&tw, sep);
+	return String_split_tw(nsplit, dest, str, &tw);
+}
+// the factorization of 'sep' is kept in the opaque bytes of the iterator and copied in and out
+typedef char String_SplitIter_fits_factor[
+	sizeof(String_TwoWay) <= sizeof(((String_SplitIter *)0)->sep_factor_) ? 1 : -1];
+
+void String_SplitIter_init(String_SplitIter * it, String const * str, String const * sep, 
+	ptrdiff_t maxsplit, _Bool reverse) {
+
+	*it = (String_SplitIter) {
+		.rest = {.str = String_data(str), .size = String_len(str) > 0 ? String_len(str) : 0},
+		.sep = sep,
+		.maxsplit = maxsplit,
+		.reverse = reverse,
+		.done = sep && String_len(sep) <= 0,
+	};
+	if (it->done || !sep) {
+		return;
+	}
+	String_TwoWay tw;
+	if (reverse) {
+		String_two_way_rinit(&tw, sep);
+	} else {
+		String_two_way_init(&tw, sep);
+	}
+	memcpy(it->sep_factor_, &tw, sizeof(tw));
+}
+_Bool String_SplitIter_next(String_SplitIter * it, String * piece) {
+	if (it->done) {
+		return false;
+	}
+	char * str_ = it->rest.str;
+	ptrdiff_t N = String_len(&it->rest);
+	if (!it->sep) { // whitespace is stripped from the end the pieces are taken from
+		if (it->reverse) {
+			N = STRING_KERNEL(String_ws_rspan_kernel)(&WHITESPACE_SET, str_, N, true);
+		} else {
+			ptrdiff_t skip = STRING_KERNEL(String_ws_span_kernel)(&WHITESPACE_SET, str_, N, true);
+			str_ += skip;
+			N -= skip;
+		}
+		if (!N) {
+			it->done = true;
+			return false;
+		}
+	}
+	if (!it->maxsplit) {
+		*piece = (String){.str = str_, .size = N};
+		it->done = true;
+		return true;
+	}
+	ptrdiff_t start = 0; // the piece is str_[start:end] and the rest str_[rest:rest_end]
+	ptrdiff_t end = N;
+	ptrdiff_t rest = N;
+	ptrdiff_t rest_end = N;
+	if (!it->sep) {
+		if (it->reverse) {
+			start = STRING_KERNEL(String_ws_rspan_kernel)(&WHITESPACE_SET, str_, N, false);
+			rest = 0;
+			rest_end = start;
+		} else {
+			end = STRING_KERNEL(String_ws_span_kernel)(&WHITESPACE_SET, str_, N, false);
+			rest = end;
+		}
+	} else {
+		String_TwoWay tw;
+		memcpy(&tw, it->sep_factor_, sizeof(tw));
+		ptrdiff_t loc = it->reverse ? String_two_way_rfind(&tw, str_, N) : 
+			STRING_KERNEL(String_find_kernel)(&tw, str_, N);
+		if (loc < 0) {
+			it->done = true;
+		} else if (it->reverse) {
+			start = loc + String_len(it->sep);
+			rest = 0;
+			rest_end = loc;
+		} else {
+			end = loc;
+			rest = loc + String_len(it->sep);
+		}
+	}
+	*piece = (String){.str = str_ + start, .size = end - start};
+	it->rest = (String){.str = str_ + rest, .size = rest_end - rest};
+	if (it->maxsplit > 0) {
+		it->maxsplit--;
+	}
+	return true;
+}
+int String_join(String * restrict dest, String const * restrict sep, ptrdiff_t n, 
+	String const * const restrict strings) {
+
+	if (!n) {
+		return -1;
+	}
+
+	if (!sep) {
+		sep = &EMPTY_STRING;
+	}
+	
+	size_t sep_size = String_len(sep) > 0 ? (size_t)String_len(sep) : 0;
+	if (sep_size && (size_t)(n - 1) > PTRDIFF_MAX / sep_size) {
+		return -1;
+	}
+	size_t min_size = (size_t)(n - 1) * sep_size;
+	for (ptrdiff_t i = 0; i < n; i++) {
+		min_size += String_len(strings + i) > 0 ? (size_t)String_len(strings + i) : 0;
+		if (min_size > PTRDIFF_MAX) {
+			return -1;
+		}
+	}
+	String_clear(dest);
+	if (String_reserve_geometric(dest, min_size)) {
+		return -1;
+	}
+	String_extend(dest, strings + 0);
+	for (ptrdiff_t j = 1; j < n; j++) {
+		String_extend(dest, sep);
+		String_extend(dest, strings + j);
+	}
+	return 0;
+}
+char * String_cstr(String * str) {
+	if (String_append(str, '\0') < 0) {
+		return NULL;
+	}
+	String_set_len(str, String_len(str) - 1); // the null-terminator that was append is not part of the string itself
+	return String_data(str);
+}
+
+int String_slice(String * restrict dest, String const * restrict str, ptrdiff_t start, ptrdiff_t end, ptrdiff_t step) {
+	if (step == 0) {
+		step = 1;
+	}
+	ptrdiff_t N = String_len(str);
+	int dir = step > 0 ? 1 : -1;
+	if (dir > 0 && end == 0) {
+		end = N;
+	}
+	if (start < 0) {
+		start = N - 1 + ((start + 1) % N);
+	}
+	if (end < 0) {
+		end = N + ((end + 1) % N);
+	}
+	// special case of end originally being -1
+	if (dir < 0) {
+		if (end == N) {
+			end = -1;
+		}
+	}
+	if ((dir < 0 && end >= start) || (dir > 0 && end <= start)) {
+		return -1;
+	}
+	
+	size_t nchars = (end - start - dir) / step + 1;
+	String_clear(dest);
+	if (String_reserve_geometric(dest, nchars)) {
+		return -1;
+	}
+	char const * str_ = String_data(str);
+	char * dest_ = String_data(dest);
+	ptrdiff_t size = 0;
+	for ( ; 0 < (end - start) * dir; start += step) {
+		dest_[size++] = str_[start];
+	}
+	String_set_len(dest, size);
+	return 0;
+}
+
+// compiled needles: the Two-Way factorization and shift table are computed once and the needle is
+// copied so the pattern does not depend on the lifetime of its source
+struct String_Pattern {
+	String_Allocator const * allocator;
+	String_TwoWay tw;
+	ptrdiff_t shift[UCHAR_MAX + 1];
+	char needle[];
+};
+
+String_Pattern * String_Pattern_new(String const * needle) {
+	if (String_len(needle) <= 0) {
+		return NULL;
+	}
+	String_Allocator const * allocator = String_default_allocator();
+	String_Pattern * pat = String_obj_alloc(allocator, sizeof(*pat) + String_len(needle) * sizeof(char));
+	if (!pat) {
+		return NULL;
+	}
+	pat->allocator = allocator;
+	memcpy(pat->needle, String_data(needle), String_len(needle) * sizeof(char));
+	String_two_way_init(&pat->tw, &(String){.str = pat->needle, .size = String_len(needle)});
+	ptrdiff_t m = String_len(needle);
+	for (int c = 0; c <= UCHAR_MAX; c++) {
+		pat->shift[c] = m;
+	}
+	for (ptrdiff_t i = 0; i < m; i++) {
+		pat->shift[(unsigned char)pat->needle[i]] = m - 1 - i;
+	}
+	pat->tw.shift = pat->shift;
+	return pat;
+}
+void String_Pattern_del(String_Pattern * pat) {
+	if (pat) {
+		String_obj_free(pat->allocator, pat, sizeof(*pat) + pat->tw.size * sizeof(char));
+	}
+}
+ptrdiff_t String_Pattern_len(String_Pattern const * pat) {
+	return pat->tw.size;
+}
+ptrdiff_t String_find_pat(String const * str, String_Pattern const * pat, ptrdiff_t start, 
+	ptrdiff_t end) {
+	
+	return String_find_tw(str, &pat->tw, start, end);
+}
+int String_count_pat(String const * str, String_Pattern const * pat, ptrdiff_t start, ptrdiff_t end) {
+	return String_count_tw(str, &pat->tw, start, end);
+}
+ptrdiff_t String_split_pat(ptrdiff_t nsplit, String * restrict dest, String * restrict str, 
+	String_Pattern const * sep) {
+
+	if (nsplit < 1) {
+		return -1;
+	}
+	return String_split_tw(nsplit, dest, str, &sep->tw);
+}
+
+// Aho-Corasick automaton over a set of needles. Bytes that do not occur in any needle share one 
+// character class, which keeps the rows of the flat transition table short. Each row starts with 
+// the index of the longest needle ending in that state (-1 if none) followed by the transitions, 
+// which are stored as offsets of the target rows
+struct String_PatternSet {
+	String_Allocator const * allocator;
+	int32_t * table;
+	int32_t * depth; // the length of the prefix each state stands for, by state index
+	ptrdiff_t * lens; // needle lengths
+	ptrdiff_t n;
+	ptrdiff_t nstates;
+	int32_t row; // nclasses + 1
+	unsigned char classes[UCHAR_MAX + 1];
+};
+
+String_PatternSet * String_PatternSet_new(ptrdiff_t n, String const * needles) {
+	if (n < 1) {
+		return NULL;
+	}
+	String_Allocator const * allocator = String_default_allocator();
+	String_PatternSet * set = String_obj_calloc(allocator, 1, sizeof(*set));
+	if (!set) {
+		return NULL;
+	}
+	set->allocator = allocator;
+	set->n = n;
+	ptrdiff_t nstates = 1;
+	_Bool seen[UCHAR_MAX + 1] = {0};
+	for (ptrdiff_t i = 0; i < n; i++) {
+		if (String_len(&needles[i]) <= 0) {
+			String_obj_free(allocator, set, sizeof(*set));
+			return NULL;
+		}
+		nstates += String_len(&needles[i]);
+		for (ptrdiff_t j = 0; j < String_len(&needles[i]); j++) {
+			seen[(unsigned char)String_data(&needles[i])[j]] = true;
+		}
+	}
+	// class 0 is shared by all the unused bytes, if any
+	int nclasses = 0;
+	for (int c = 0; c <= UCHAR_MAX; c++) {
+		if (!seen[c]) {
+			nclasses = 1;
+			break;
+		}
+	}
+	for (int c = 0; c <= UCHAR_MAX; c++) {
+		if (seen[c]) {
+			set->classes[c] = (unsigned char)nclasses++;
+		}
+	}
+	int32_t const row = nclasses + 1;
+	set->row = row;
+	if (nstates > INT32_MAX / row) {
+		String_obj_free(allocator, set, sizeof(*set));
+		return NULL;
+	}
+	set->nstates = nstates;
+	set->table = String_obj_calloc(allocator, nstates * row, sizeof(*set->table));
+	set->depth = String_obj_calloc(allocator, nstates, sizeof(*set->depth));
+	set->lens = String_obj_alloc(allocator, n * sizeof(*set->lens));
+	int32_t * queue = String_obj_alloc(allocator, nstates * sizeof(*queue)); // breadth first order of states
+	int32_t * fail = String_obj_alloc(allocator, nstates * sizeof(*fail)); // failure links by state index
+	if (!set->table || !set->depth || !set->lens || !queue || !fail) {
+		String_obj_free(allocator, fail, nstates * sizeof(*fail));
+		String_obj_free(allocator, queue, nstates * sizeof(*queue));
+		String_PatternSet_del(set);
+		return NULL;
+	}
+	int32_t * table = set->table;
+
+	// build the trie. a transition of 0 is a missing edge since no edge leads back to the root
+	int32_t used = row;
+	table[0] = -1;
+	for (ptrdiff_t i = 0; i < n; i++) {
+		set->lens[i] = String_len(&needles[i]);
+		int32_t state = 0;
+		for (ptrdiff_t j = 0; j < String_len(&needles[i]); j++) {
+			int32_t * next = table + state + 1 + set->classes[(unsigned char)String_data(&needles[i])[j]];
+			if (!*next) {
+				*next = used;
+				table[used] = -1;
+				set->depth[used / row] = set->depth[state / row] + 1;
+				used += row;
+			}
+			state = *next;
+		}
+		if (table[state] < 0) { // the first of duplicate needles wins
+			table[state] = (int32_t)i;
+		}
+	}
+
+	// fill in the missing transitions in breadth first order from the failure links
+	ptrdiff_t head = 0;
+	ptrdiff_t tail = 0;
+	for (int c = 1; c < row; c++) {
+		if (table[c]) {
+			fail[table[c] / row] = 0;
+			queue[tail++] = table[c];
+		}
+	}
+	while (head < tail) {
+		int32_t state = queue[head++];
+		int32_t back = fail[state / row];
+		if (table[state] < 0) {
+			table[state] = table[back];
+		}
+		for (int c = 1; c < row; c++) {
+			int32_t * next = table + state + c;
+			if (*next) {
+				fail[*next / row] = table[back + c];
+				queue[tail++] = *next;
 			} else {
-				str->str = str_;
-			}				
-		} else if (str->capacity) {
-			free(str->str);
-			*str = (String) {0};
-		}
-	}
-	if (str->str) { // memory allocations succeeded
-		if (buf) {
-			*str = (String) {
-				.str = memcpy(str->str, buf, size * sizeof(char)),
-				.size = size,
-				.capacity = capacity
-			};
+				*next = table[back + c];
+			}
+		}
+	}
+	String_obj_free(allocator, fail, nstates * sizeof(*fail));
+	String_obj_free(allocator, queue, nstates * sizeof(*queue));
+	return set;
+}
+void String_PatternSet_del(String_PatternSet * set) {
+	if (set) {
+		String_Allocator const * allocator = set->allocator;
+		String_obj_free(allocator, set->lens, set->n * sizeof(*set->lens));
+		String_obj_free(allocator, set->depth, set->nstates * sizeof(*set->depth));
+		String_obj_free(allocator, set->table, set->nstates * set->row * sizeof(*set->table));
+		String_obj_free(allocator, set, sizeof(*set));
+	}
+}
+
+// returns the offset of the earliest (and then longest) match in hay[:size] or -1 if not found
+static ptrdiff_t String_find_any_(String_PatternSet const * set, char const * hay, ptrdiff_t size, 
+	ptrdiff_t * which) {
+
+	int32_t const * table = set->table;
+	unsigned char const * classes = set->classes;
+	ptrdiff_t best = -1;
+	int32_t state = 0;
+	for (ptrdiff_t i = 0; i < size; i++) {
+		state = table[state + 1 + classes[(unsigned char)hay[i]]];
+		int32_t out = table[state];
+		if (out >= 0) {
+			ptrdiff_t loc = i + 1 - set->lens[out];
+			if (best < 0 || loc <= best) {
+				best = loc;
+				*which = out;
+			}
+		}
+		// a match starting at or before best that ends later would have to extend the prefix the
+		// state stands for, which starts after best once it is shorter than i + 1 - best
+		if (best >= 0 && set->depth[state / set->row] < i + 1 - best) {
+			break;
+		}
+	}
+	return best;
+}
+ptrdiff_t String_find_any(String const * str, String_PatternSet const * set, ptrdiff_t start, 
+	ptrdiff_t end, ptrdiff_t * which) {
+
+	ptrdiff_t which_ = -1;
+	if (0 >= String_len(str) || !String_range(str, &start, &end)) {
+		return -1;
+	}
+	ptrdiff_t loc = String_find_any_(set, String_data(str) + start, end - start, &which_);
+	if (which) {
+		*which = which_;
+	}
+	return loc < 0 ? -1 : start + loc;
+}
+int String_count_any(String const * str, String_PatternSet const * set, ptrdiff_t start, 
+	ptrdiff_t end) {
+
+	int ct = 0;
+	if (0 >= String_len(str) || !String_range(str, &start, &end)) {
+		return ct;
+	}
+	ptrdiff_t which = -1;
+	ptrdiff_t loc = String_find_any_(set, String_data(str) + start, end - start, &which);
+	while (loc >= 0) {
+		ct++;
+		start += loc + set->lens[which];
+		loc = String_find_any_(set, String_data(str) + start, end - start, &which);
+	}
+	return ct;
+}
+
+// streams 'src' into 'dest' from the match of needle 'which' at 'loc', replacing each match of 
+// 'set' with its String in 'new'. dest is appended to. returns the number of matches or -1
+static ptrdiff_t String_replace_any_(String * restrict dest, char const * restrict src, ptrdiff_t size, 
+	String_PatternSet const * set, String const * new, ptrdiff_t loc, ptrdiff_t which) {
+
+	ptrdiff_t nrep = 0;
+	ptrdiff_t read = 0;
+	for (; loc >= 0; nrep++) {
+		String const * rep = new + which;
+		ptrdiff_t n = String_len(rep);
+		if (String_reserve_geometric(dest, (size_t)String_len(dest) + loc + n)) {
+			return -1;
+		}
+		char * dest_ = String_data(dest) + String_len(dest);
+		if (loc) {
+			memcpy(dest_, src + read, loc * sizeof(char));
+		}
+		if (n) {
+			memcpy(dest_ + loc, String_data(rep), n * sizeof(char));
+		}
+		String_set_len(dest, String_len(dest) + loc + n);
+		read += loc + set->lens[which];
+		loc = String_find_any_(set, src + read, size - read, &which);
+	}
+	if (String_reserve_geometric(dest, (size_t)String_len(dest) + (size - read))) {
+		return -1;
+	}
+	if (size > read) {
+		memcpy(String_data(dest) + String_len(dest), src + read, (size - read) * sizeof(char));
+	}
+	String_set_len(dest, String_len(dest) + size - read);
+	return nrep;
+}
+int String_replace_any(String * str, String_PatternSet const * set, String const * new) {
+	ptrdiff_t N = String_len(str);
+	if (N <= 0) {
+		return 0;
+	}
+	ptrdiff_t which = -1;
+	ptrdiff_t loc = String_find_any_(set, String_data(str), N, &which);
+	if (loc < 0) {
+		return 0;
+	}
+	_Bool grows = false;
+	for (ptrdiff_t i = 0; i < set->n; i++) {
+		grows |= String_len(&new[i]) > set->lens[i];
+	}
+	if (grows) {
+		// stream into a new buffer, which only grows geometrically as matches are found
+		String out = {0};
+		String_init_(String_allocator_of(str), &out, NULL, 0, N);
+		if (!out.capacity) {
+			return -1;
+		}
+		ptrdiff_t nrep = String_replace_any_(&out, String_data(str), N, set, new, loc, which);
+		if (nrep < 0) {
+			String_dest(&out);
+			return -1;
+		}
+		String_dest(str);
+		*str = out;
+		return (int)nrep;
+	}
+	// the output never overtakes the input: compact front to back as matches are found
+	if (String_unshare(str)) {
+		return -1;
+	}
+	char * str_ = String_data(str);
+	ptrdiff_t nrep = 0;
+	ptrdiff_t r = 0;
+	ptrdiff_t w = 0;
+	for (; loc >= 0; nrep++) {
+		String const * rep = new + which;
+		ptrdiff_t n = String_len(rep);
+		if (w != r) {
+			memmove(str_ + w, str_ + r, loc * sizeof(char));
+		}
+		if (n) {
+			memcpy(str_ + w + loc, String_data(rep), n * sizeof(char));
+		}
+		w += loc + n;
+		r += loc + set->lens[which];
+		loc = String_find_any_(set, str_ + r, N - r, &which);
+	}
+	if (w != r) {
+		memmove(str_ + w, str_ + r, (N - r) * sizeof(char));
+	}
+	String_set_len(str, w + N - r);
+	return (int)nrep;
+}
+int String_replace_many(String * str, ptrdiff_t n, String const * old, String const * new) {
+	if (String_len(str) <= 0) {
+		return 0;
+	}
+	String_PatternSet * set = String_PatternSet_new(n, old);
+	if (!set) {
+		return -1;
+	}
+	int nrep = String_replace_any(str, set, new);
+	String_PatternSet_del(set);
+	return nrep;
+}
+
+// String_Map is an open-addressing table in the style of Swiss tables. Each slot has a control byte
+// that is either STRING_MAP_EMPTY or the top 7 bits of the hash of its key. Lookups compare a group
+// of 16 control bytes at once and only compare the keys whose bytes match. Probing is linear and
+// deletion shifts later entries back, so there are no tombstones and every slot between the home
+// slot of a key and the key itself is full. The control bytes of the first group are repeated
+// after the last slot so a group can be loaded at any slot
+#define STRING_MAP_EMPTY 0x80
+#define STRING_MAP_GROUP 16
+#define STRING_MAP_MIN_CAPACITY 16
+
+typedef struct String_MapEntry {
+	String key;
+	uint64_t hash;
+} String_MapEntry;
+
+struct String_Map {
+	String_Allocator const * allocator;
+	unsigned char * ctrl; // capacity + STRING_MAP_GROUP bytes
+	String_MapEntry * entries;
+	// packed: each value is aligned to the largest power of 2 dividing value_size, up to the 
+	// alignment of the block
+	unsigned char * values;
+	size_t value_size;
+	ptrdiff_t capacity; // a power of 2
+	ptrdiff_t size;
+	uint64_t seed;
+};
+
+static inline unsigned char String_Map_h2(uint64_t hash) {
+	return (unsigned char)(hash >> 57);
+}
+
+// SSE2 is part of x86-64, so the group scans are inlined rather than dispatched at runtime
+#if defined(STRING_X86) && defined(__SSE2__)
+static inline unsigned String_Map_match(unsigned char const * group, unsigned char h2) {
+	__m128i ctrl = _mm_loadu_si128((__m128i const *)group);
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
+static inline unsigned String_Map_empties(unsigned char const * group) {
+	return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((__m128i const *)group));
+}
+#else
+static inline unsigned String_Map_match(unsigned char const * group, unsigned char h2) {
+	unsigned mask = 0;
+	for (int i = 0; i < STRING_MAP_GROUP; i++) {
+		mask |= (unsigned)(group[i] == h2) << i;
+	}
+	return mask;
+}
+static inline unsigned String_Map_empties(unsigned char const * group) {
+	unsigned mask = 0;
+	for (int i = 0; i < STRING_MAP_GROUP; i++) {
+		mask |= (unsigned)(group[i] >> 7) << i;
+	}
+	return mask;
+}
+#endif
+
+static inline int String_Map_ctz(unsigned mask) {
+#ifdef __GNUC__
+	return __builtin_ctz(mask);
+#else
+	int n = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+static inline void String_Map_set_ctrl(String_Map * map, ptrdiff_t i, unsigned char c) {
+	map->ctrl[i] = c;
+	if (i < STRING_MAP_GROUP) {
+		map->ctrl[map->capacity + i] = c;
+	}
+}
+
+// returns the slot of 'key' or -1
+static ptrdiff_t String_Map_slot(String_Map const * map, String const * key, uint64_t hash) {
+	ptrdiff_t const mask = map->capacity - 1;
+	unsigned char const h2 = String_Map_h2(hash);
+	ptrdiff_t i = (ptrdiff_t)(hash & (uint64_t)mask);
+	for (ptrdiff_t probed = 0; probed < map->capacity; probed += STRING_MAP_GROUP) {
+		unsigned char const * group = map->ctrl + i;
+		for (unsigned m = String_Map_match(group, h2); m; m &= m - 1) {
+			ptrdiff_t slot = (i + String_Map_ctz(m)) & mask;
+			String_MapEntry const * e = map->entries + slot;
+			if (e->hash == hash && String_equal(&e->key, key)) {
+				return slot;
+			}
+		}
+		if (String_Map_empties(group)) {
+			break;
+		}
+		i = (i + STRING_MAP_GROUP) & mask;
+	}
+	return -1;
+}
+
+// returns the first empty slot at or after the home slot of 'hash'. the table is never full
+static ptrdiff_t String_Map_free_slot(String_Map const * map, uint64_t hash) {
+	ptrdiff_t const mask = map->capacity - 1;
+	ptrdiff_t i = (ptrdiff_t)(hash & (uint64_t)mask);
+	unsigned m;
+	while (!(m = String_Map_empties(map->ctrl + i))) {
+		i = (i + STRING_MAP_GROUP) & mask;
+	}
+	return (i + String_Map_ctz(m)) & mask;
+}
+
+// inserts a key known not to be in the map with a zeroed value. returns its slot or -1
+static ptrdiff_t String_Map_insert(String_Map * map, String const * key, uint64_t hash) {
+	if (String_Map_reserve(map, map->size + 1)) {
+		return -1;
+	}
+	ptrdiff_t slot = String_Map_free_slot(map, hash);
+	String_Map_set_ctrl(map, slot, String_Map_h2(hash));
+	map->entries[slot] = (String_MapEntry) {.key = *key, .hash = hash};
+	memset(map->values + slot * map->value_size, 0, map->value_size);
+	map->size++;
+	return slot;
+}
+
+String_Map * String_Map_new(size_t value_size, ptrdiff_t n) {
+	String_Allocator const * allocator = String_default_allocator();
+	String_Map * map = String_obj_calloc(allocator, 1, sizeof(*map));
+	if (!map) {
+		return NULL;
+	}
+	map->allocator = allocator;
+	map->value_size = value_size;
+	map->seed = String_table_seed(map);
+	if (String_Map_rehash(map, n)) {
+		String_obj_free(allocator, map, sizeof(*map));
+		return NULL;
+	}
+	return map;
+}
+// a set still gets a (1 byte) value block so that found keys have non-NULL values
+static inline size_t String_Map_values_size(String_Map const * map, ptrdiff_t capacity) {
+	return map->value_size ? capacity * map->value_size : 1;
+}
+// frees the arrays of 'map' for its capacity
+static void String_Map_free_arrays(String_Map const * map) {
+	String_obj_free(map->allocator, map->values, String_Map_values_size(map, map->capacity));
+	String_obj_free(map->allocator, map->entries, map->capacity * sizeof(*map->entries));
+	String_obj_free(map->allocator, map->ctrl, map->capacity + STRING_MAP_GROUP);
+}
+void String_Map_del(String_Map * map) {
+	if (map) {
+		String_Map_free_arrays(map);
+		String_obj_free(map->allocator, map, sizeof(*map));
+	}
+}
+ptrdiff_t String_Map_len(String_Map const * map) {
+	return map->size;
+}
+int String_Map_rehash(String_Map * map, ptrdiff_t n) {
+	if (n < map->size) {
+		n = map->size;
+	}
+	// keep the load at most 3/4
+	ptrdiff_t capacity = STRING_MAP_MIN_CAPACITY;
+	while (capacity / 4 * 3 < n) {
+		if (capacity > PTRDIFF_MAX / 2 / (ptrdiff_t)sizeof(String_MapEntry)) {
+			return -1;
+		}
+		capacity *= 2;
+	}
+	if (capacity == map->capacity) {
+		return 0;
+	}
+	String_Map old = *map;
+	map->ctrl = String_obj_alloc(map->allocator, capacity + STRING_MAP_GROUP);
+	map->entries = String_obj_alloc(map->allocator, capacity * sizeof(*map->entries));
+	map->values = String_obj_alloc(map->allocator, String_Map_values_size(map, capacity));
+	if (!map->ctrl || !map->entries || !map->values) {
+		map->capacity = capacity;
+		String_Map_free_arrays(map);
+		*map = old;
+		return -1;
+	}
+	memset(map->ctrl, STRING_MAP_EMPTY, capacity + STRING_MAP_GROUP);
+	map->capacity = capacity;
+	for (ptrdiff_t i = 0; i < old.capacity; i++) {
+		if (old.ctrl[i] != STRING_MAP_EMPTY) {
+			ptrdiff_t slot = String_Map_free_slot(map, old.entries[i].hash);
+			String_Map_set_ctrl(map, slot, old.ctrl[i]);
+			map->entries[slot] = old.entries[i];
+			memcpy(map->values + slot * map->value_size, old.values + i * map->value_size, map->value_size);
+		}
+	}
+	String_Map_free_arrays(&old);
+	return 0;
+}
+int String_Map_reserve(String_Map * map, ptrdiff_t n) {
+	return n > map->capacity / 4 * 3 ? String_Map_rehash(map, n) : 0;
+}
+void * String_Map_get(String_Map const * map, String const * key) {
+	ptrdiff_t slot = String_Map_slot(map, key, String_hash(key, map->seed));
+	return slot < 0 ? NULL : map->values + slot * map->value_size;
+}
+void * String_Map_put(String_Map * map, String const * key, _Bool * inserted) {
+	uint64_t hash = String_hash(key, map->seed);
+	ptrdiff_t slot = String_Map_slot(map, key, hash);
+	if (inserted) {
+		*inserted = slot < 0;
+	}
+	if (slot >= 0) {
+		return map->values + slot * map->value_size;
+	}
+	slot = String_Map_insert(map, key, hash);
+	return slot < 0 ? NULL : map->values + slot * map->value_size;
+}
+_Bool String_Map_remove(String_Map * map, String const * key, void * value) {
+	ptrdiff_t i = String_Map_slot(map, key, String_hash(key, map->seed));
+	if (i < 0) {
+		return false;
+	}
+	if (value) {
+		memcpy(value, map->values + i * map->value_size, map->value_size);
+	}
+	// shift back each following entry whose home slot is at or before the hole
+	ptrdiff_t const mask = map->capacity - 1;
+	for (ptrdiff_t j = (i + 1) & mask; map->ctrl[j] != STRING_MAP_EMPTY; j = (j + 1) & mask) {
+		ptrdiff_t home = (ptrdiff_t)(map->entries[j].hash & (uint64_t)mask);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			String_Map_set_ctrl(map, i, map->ctrl[j]);
+			map->entries[i] = map->entries[j];
+			memcpy(map->values + i * map->value_size, map->values + j * map->value_size, map->value_size);
+			i = j;
+		}
+	}
+	String_Map_set_ctrl(map, i, STRING_MAP_EMPTY);
+	map->size--;
+	return true;
+}
+_Bool String_Map_next(String_Map const * map, ptrdiff_t * iter, String * key, void ** value) {
+	for (ptrdiff_t i = *iter; i < map->capacity; i++) {
+		if (map->ctrl[i] != STRING_MAP_EMPTY) {
+			*iter = i + 1;
+			if (key) {
+				*key = map->entries[i].key;
+			}
+			if (value) {
+				*value = map->values + i * map->value_size;
+			}
+			return true;
+		}
+	}
+	*iter = map->capacity;
+	return false;
+}
+
+// String_Intern copies each distinct string once into blocks that are never moved or freed before 
+// the pool, and indexes the copies with a String_Map set
+#define STRING_INTERN_BLOCK 4096
+
+typedef struct String_InternBlock {
+	struct String_InternBlock * next;
+	size_t used;
+	size_t size;
+	char data[];
+} String_InternBlock;
+
+struct String_Intern {
+	String_Allocator const * allocator;
+	String_Map * set;
+	String_InternBlock * blocks;
+};
+
+String_Intern * String_Intern_new(void) {
+	String_Allocator const * allocator = String_default_allocator();
+	String_Intern * pool = String_obj_calloc(allocator, 1, sizeof(*pool));
+	if (!pool) {
+		return NULL;
+	}
+	pool->allocator = allocator;
+	pool->set = String_Map_new(0, 0);
+	if (!pool->set) {
+		String_obj_free(allocator, pool, sizeof(*pool));
+		return NULL;
+	}
+	return pool;
+}
+void String_Intern_del(String_Intern * pool) {
+	if (pool) {
+		String_Map_del(pool->set);
+		while (pool->blocks) {
+			String_InternBlock * next = pool->blocks->next;
+			String_obj_free(pool->allocator, pool->blocks, sizeof(*pool->blocks) + pool->blocks->size);
+			pool->blocks = next;
+		}
+		String_obj_free(pool->allocator, pool, sizeof(*pool));
+	}
+}
+ptrdiff_t String_Intern_len(String_Intern const * pool) {
+	return String_Map_len(pool->set);
+}
+// copies n bytes and a null terminator into the pool
+static char * String_Intern_copy(String_Intern * pool, char const * buf, size_t n) {
+	String_InternBlock * block = pool->blocks;
+	if (!block || block->size - block->used < n + 1) {
+		// strings longer than a quarter block get a block of their own behind the current one so
+		// that the space left in the current block is not wasted
+		size_t size = n + 1 > STRING_INTERN_BLOCK / 4 ? n + 1 : STRING_INTERN_BLOCK;
+		String_InternBlock * fresh = String_obj_alloc(pool->allocator, sizeof(*fresh) + size);
+		if (!fresh) {
+			return NULL;
+		}
+		fresh->used = 0;
+		fresh->size = size;
+		if (block && size != STRING_INTERN_BLOCK) {
+			fresh->next = block->next;
+			block->next = fresh;
 		} else {
-			str->capacity = capacity;
-		};
+			fresh->next = block;
+			pool->blocks = fresh;
+		}
+		block = fresh;
+	}
+	char * dest = block->data + block->used;
+	memcpy(dest, buf, n);
+	dest[n] = '\0';
+	block->used += n + 1;
+	return dest;
+}
+int String_intern(String_Intern * pool, String const * str, String * handle) {
+	if (String_len(str) < 0) {
+		return -1;
+	}
+	uint64_t hash = String_hash(str, pool->set->seed);
+	ptrdiff_t slot = String_Map_slot(pool->set, str, hash);
+	if (slot < 0) {
+		char * copy = String_Intern_copy(pool, String_data(str), String_len(str));
+		if (!copy) {
+			return -1;
+		}
+		// the copy stays in the block if the insert fails; it is only lost space
+		slot = String_Map_insert(pool->set, &(String){.str = copy, .size = String_len(str)}, hash);
+		if (slot < 0) {
+			return -1;
+		}
+	}
+	*handle = pool->set->entries[slot].key;
+	return 0;
+}
+_Bool String_Intern_find(String_Intern const * pool, String const * str, String * handle) {
+	ptrdiff_t slot = String_Map_slot(pool->set, str, String_hash(str, pool->set->seed));
+	if (slot >= 0 && handle) {
+		*handle = pool->set->entries[slot].key;
+	}
+	return slot >= 0;
+}
+
+// String_ConcurrentIntern is an insert-only set of entries in a chain of open-addressing tables of
+// pointers. Slots only ever change from NULL to an entry, by CAS, so a key is always in the first
+// slot of its probe sequence that was NULL when it was inserted and racing inserts of the same key
+// find each other. A key whose STRING_CINTERN_PROBES slots are all taken in a table moves on to the
+// next table, which is twice as large and created on demand. Whether a key overflows a table never
+// changes once its slots are full, so every thread agrees on where a key belongs. Lookups are
+// wait-free: at most STRING_CINTERN_PROBES loads per table. Entries are allocated from arenas that
+// belong to one thread each and are freed with the table
+
+#define STRING_CINTERN_PROBES 16
+#define STRING_CINTERN_BLOCK 65536
+
+typedef struct String_CInternEntry {
+	uint64_t hash;
+	ptrdiff_t size;
+	char data[];
+} String_CInternEntry;
+
+typedef struct String_CInternTable {
+	struct String_CInternTable * next;
+	ptrdiff_t mask;
+	String_CInternEntry * slots[];
+} String_CInternTable;
+
+typedef struct String_CInternBlock {
+	struct String_CInternBlock * next;
+	size_t used;
+	size_t size;
+	uint64_t data[]; // entries, each aligned like the first
+} String_CInternBlock;
+
+struct String_InternArena {
+	String_Allocator const * allocator;
+	String_InternArena * next;
+	String_CInternBlock * blocks;
+};
+
+struct String_ConcurrentIntern {
+	String_Allocator const * allocator;
+	String_CInternTable * tables;
+	String_InternArena * arenas;
+	ptrdiff_t size;
+	uint64_t seed;
+};
+
+static inline size_t String_CInternTable_bytes(ptrdiff_t capacity) {
+	return sizeof(String_CInternTable) + capacity * sizeof(((String_CInternTable *)0)->slots[0]);
+}
+static String_CInternTable * String_CInternTable_new(String_Allocator const * allocator, 
+	ptrdiff_t capacity) {
+
+	String_CInternTable * table = String_obj_calloc(allocator, 1, String_CInternTable_bytes(capacity));
+	if (table) {
+		table->mask = capacity - 1;
+	}
+	return table;
+}
+
+String_ConcurrentIntern * String_ConcurrentIntern_new(ptrdiff_t n) {
+	String_Allocator const * allocator = String_default_allocator();
+	String_ConcurrentIntern * pool = String_obj_calloc(allocator, 1, sizeof(*pool));
+	if (!pool) {
+		return NULL;
+	}
+	pool->allocator = allocator;
+	pool->seed = String_table_seed(pool);
+	ptrdiff_t capacity = 64;
+	while (capacity < 2 * n && capacity <= PTRDIFF_MAX / 4 / (ptrdiff_t)sizeof(void *)) {
+		capacity *= 2;
+	}
+	pool->tables = String_CInternTable_new(allocator, capacity);
+	if (!pool->tables) {
+		String_obj_free(allocator, pool, sizeof(*pool));
+		return NULL;
+	}
+	return pool;
+}
+void String_ConcurrentIntern_del(String_ConcurrentIntern * pool) {
+	if (!pool) {
+		return;
+	}
+	String_Allocator const * allocator = pool->allocator;
+	while (pool->tables) {
+		String_CInternTable * next = pool->tables->next;
+		String_obj_free(allocator, pool->tables, String_CInternTable_bytes(pool->tables->mask + 1));
+		pool->tables = next;
+	}
+	while (pool->arenas) {
+		String_InternArena * next = pool->arenas->next;
+		while (pool->arenas->blocks) {
+			String_CInternBlock * block = pool->arenas->blocks->next;
+			String_obj_free(allocator, pool->arenas->blocks, 
+				sizeof(*pool->arenas->blocks) + pool->arenas->blocks->size);
+			pool->arenas->blocks = block;
+		}
+		String_obj_free(allocator, pool->arenas, sizeof(*pool->arenas));
+		pool->arenas = next;
+	}
+	String_obj_free(allocator, pool, sizeof(*pool));
+}
+String_InternArena * String_ConcurrentIntern_arena(String_ConcurrentIntern * pool) {
+	String_InternArena * arena = String_obj_calloc(pool->allocator, 1, sizeof(*arena));
+	if (!arena) {
+		return NULL;
+	}
+	arena->allocator = pool->allocator;
+	arena->next = STRING_ATOMIC_LOAD(&pool->arenas);
+	while (!STRING_ATOMIC_CAS(&pool->arenas, &arena->next, arena)) {
+		// arena->next was reloaded by the failed CAS
+	}
+	return arena;
+}
+ptrdiff_t String_ConcurrentIntern_len(String_ConcurrentIntern const * pool) {
+	return STRING_ATOMIC_LOAD(&pool->size);
+}
+
+static inline _Bool String_CInternEntry_is(String_CInternEntry const * entry, String const * str, 
+	uint64_t hash) {
+
+	ptrdiff_t n = String_len(str);
+	return entry->hash == hash && entry->size == n && 
+		(!n || STRING_KERNEL(String_mismatch_kernel)(entry->data, String_data(str), n) == n);
+}
+
+// searches the chain from 'table'. returns the entry or NULL. if 'last' is not NULL, it receives 
+// the table the key belongs in
+static String_CInternEntry * String_CIntern_search(String_CInternTable * table, String const * str,
+	uint64_t hash, String_CInternTable ** last) {
+
+	while (table) {
+		ptrdiff_t i = (ptrdiff_t)(hash & (uint64_t)table->mask);
+		for (int probe = 0; probe < STRING_CINTERN_PROBES; probe++) {
+			String_CInternEntry * entry = STRING_ATOMIC_LOAD(&table->slots[(i + probe) & table->mask]);
+			if (!entry) {
+				if (last) {
+					*last = table;
+				}
+				return NULL;
+			} else if (String_CInternEntry_is(entry, str, hash)) {
+				return entry;
+			}
+		}
+		if (last) {
+			*last = table;
+		}
+		table = STRING_ATOMIC_LOAD(&table->next);
+	}
+	return NULL;
+}
+
+static String_CInternEntry * String_InternArena_alloc(String_InternArena * arena, ptrdiff_t size) {
+	size_t align = sizeof(uint64_t);
+	size_t need = (sizeof(String_CInternEntry) + size + 1 + align - 1) / align * align;
+	String_CInternBlock * block = arena->blocks;
+	if (!block || block->size - block->used < need) {
+		size_t bytes = need > STRING_CINTERN_BLOCK / 4 ? need : STRING_CINTERN_BLOCK;
+		block = String_obj_alloc(arena->allocator, sizeof(*block) + bytes);
+		if (!block) {
+			return NULL;
+		}
+		block->used = 0;
+		block->size = bytes;
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+	String_CInternEntry * entry = (String_CInternEntry *)((char *)block->data + block->used);
+	block->used += need;
+	return entry;
+}
+// gives back the most recent allocation of the arena
+static void String_InternArena_undo(String_InternArena * arena, String_CInternEntry * entry) {
+	arena->blocks->used = (size_t)((char *)entry - (char *)arena->blocks->data);
+}
+
+int String_ConcurrentIntern_add(String_ConcurrentIntern * pool, String_InternArena * arena, 
+	String const * str, String * handle) {
+
+	if (String_len(str) < 0) {
+		return -1;
+	}
+	uint64_t hash = String_hash(str, pool->seed);
+	String_CInternTable * table = pool->tables;
+	String_CInternEntry * found = String_CIntern_search(table, str, hash, &table);
+	if (found) {
+		*handle = (String) {.str = found->data, .size = found->size};
+		return 0;
+	}
+	String_CInternEntry * entry = String_InternArena_alloc(arena, String_len(str));
+	if (!entry) {
+		return -1;
+	}
+	entry->hash = hash;
+	entry->size = String_len(str);
+	memcpy(entry->data, String_data(str), String_len(str));
+	entry->data[String_len(str)] = '\0';
+	while (true) {
+		ptrdiff_t i = (ptrdiff_t)(hash & (uint64_t)table->mask);
+		for (int probe = 0; probe < STRING_CINTERN_PROBES; probe++) {
+			String_CInternEntry ** slot = &table->slots[(i + probe) & table->mask];
+			String_CInternEntry * expected = NULL;
+			if (STRING_ATOMIC_CAS(slot, &expected, entry)) {
+				STRING_ATOMIC_ADD(&pool->size, 1);
+				*handle = (String) {.str = entry->data, .size = entry->size};
+				return 0;
+			}
+			if (String_CInternEntry_is(expected, str, hash)) { // lost a race to the same key
+				String_InternArena_undo(arena, entry);
+				*handle = (String) {.str = expected->data, .size = expected->size};
+				return 0;
+			}
+		}
+		// the key overflows this table. make sure there is a next one
+		String_CInternTable * next = STRING_ATOMIC_LOAD(&table->next);
+		if (!next) {
+			String_CInternTable * fresh = String_CInternTable_new(pool->allocator, 2 * (table->mask + 1));
+			if (!fresh) {
+				String_InternArena_undo(arena, entry);
+				return -1;
+			}
+			if (STRING_ATOMIC_CAS(&table->next, &next, fresh)) {
+				next = fresh;
+			} else {
+				String_obj_free(pool->allocator, fresh, String_CInternTable_bytes(fresh->mask + 1));
+			}
+		}
+		table = next;
+	}
+}
+_Bool String_ConcurrentIntern_find(String_ConcurrentIntern const * pool, String const * str, 
+	String * handle) {
+
+	String_CInternEntry * found = String_CIntern_search(pool->tables, str, String_hash(str, pool->seed), 
+		NULL);
+	if (found && handle) {
+		*handle = (String) {.str = found->data, .size = found->size};
+	}
+	return found;
+}
+
+// String_Builder appends into a list of chunks in order. each chunk has a spare byte after its 
+// size for the null terminator that vsnprintf writes
+#define STRING_BUILDER_CHUNK 4096
+
+typedef struct String_BuilderChunk {
+	struct String_BuilderChunk * next;
+	size_t used;
+	size_t size;
+	char data[];
+} String_BuilderChunk;
+
+struct String_Builder {
+	String_Allocator const * allocator;
+	String_BuilderChunk * head;
+	String_BuilderChunk * tail;
+	size_t chunk_size;
+	ptrdiff_t size;
+};
+
+String_Builder * String_Builder_new(size_t chunk_size) {
+	String_Allocator const * allocator = String_default_allocator();
+	String_Builder * builder = String_obj_calloc(allocator, 1, sizeof(*builder));
+	if (builder) {
+		builder->allocator = allocator;
+		builder->chunk_size = chunk_size ? chunk_size : STRING_BUILDER_CHUNK;
+	}
+	return builder;
+}
+static void String_BuilderChunk_free(String_Builder const * builder, String_BuilderChunk * chunk) {
+	String_obj_free(builder->allocator, chunk, sizeof(*chunk) + chunk->size + 1);
+}
+void String_Builder_clear(String_Builder * builder) {
+	// keep the first chunk for reuse
+	String_BuilderChunk * chunk = builder->head;
+	if (chunk) {
+		while (chunk->next) {
+			String_BuilderChunk * next = chunk->next->next;
+			String_BuilderChunk_free(builder, chunk->next);
+			chunk->next = next;
+		}
+		chunk->used = 0;
 	}
+	builder->tail = chunk;
+	builder->size = 0;
 }
-void String_partition(String * str, String const * sep, String * restrict suffix) {
-	if (sep->size <= 0 || str->size < sep->size) {
-		String_init(suffix, NULL, 0, 0);
-		return;
+void String_Builder_del(String_Builder * builder) {
+	if (builder) {
+		String_Builder_clear(builder);
+		if (builder->head) {
+			String_BuilderChunk_free(builder, builder->head);
+		}
+		String_obj_free(builder->allocator, builder, sizeof(*builder));
 	}
-	char first_sep = sep->str[0];
-	ptrdiff_t i = 0;
-	ptrdiff_t N = str->size;
-	char * str_ = str->str;
-	while (i < N) {
-		if (!strncmp(str_ + i, sep->str, sep->size)) {
-			String_init(suffix, str_ + i + sep->size, N - i - sep->size, 0);
-			str->size = i;
-			return;
+}
+ptrdiff_t String_Builder_len(String_Builder const * builder) {
+	return builder->size;
+}
+// the free space in the last chunk
+static inline size_t String_Builder_room(String_Builder const * builder) {
+	return builder->tail ? builder->tail->size - builder->tail->used : 0;
+}
+// links a chunk for at least n more chars after the last one. returns NULL on allocation failure
+static String_BuilderChunk * String_Builder_grow(String_Builder * builder, size_t n) {
+	size_t size = n > builder->chunk_size ? n : builder->chunk_size;
+	if (size > PTRDIFF_MAX - sizeof(String_BuilderChunk) - 1) {
+		return NULL;
+	}
+	String_BuilderChunk * chunk = String_obj_alloc(builder->allocator, sizeof(*chunk) + size + 1);
+	if (!chunk) {
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->used = 0;
+	chunk->size = size;
+	if (builder->tail) {
+		builder->tail->next = chunk;
+	} else {
+		builder->head = chunk;
+	}
+	builder->tail = chunk;
+	return chunk;
+}
+int String_Builder_append(String_Builder * builder, char chr) {
+	if (!String_Builder_room(builder) && !String_Builder_grow(builder, 1)) {
+		return -1;
+	}
+	builder->tail->data[builder->tail->used++] = chr;
+	builder->size++;
+	return 0;
+}
+int String_Builder_extend(String_Builder * builder, String const * str) {
+	if (String_len(str) <= 0) {
+		return String_len(str) < 0 ? -1 : 0;
+	} else if (String_len(str) > PTRDIFF_MAX - builder->size) {
+		return -1;
+	}
+	char const * str_ = String_data(str);
+	size_t n = (size_t)String_len(str);
+	size_t room = String_Builder_room(builder);
+	if (room < n) {
+		// fill the last chunk and put the rest in a new one
+		String_BuilderChunk * last = builder->tail;
+		if (!String_Builder_grow(builder, n - room)) {
+			return -1;
 		}
-		i++;
-		while (i < N && str_[i] != first_sep) {
-			i++;
+		if (room) {
+			memcpy(last->data + last->used, str_, room);
+			last->used += room;
 		}
+		str_ += room;
+		n -= room;
 	}
-	String_init(suffix, NULL, 0, 0);
+	memcpy(builder->tail->data + builder->tail->used, str_, n);
+	builder->tail->used += n;
+	builder->size += String_len(str);
+	return 0;
 }
-void String_rpartition(String * str, String const * sep, String * restrict suffix) {
-	if (sep->size <= 0 || str->size < sep->size) {
-		String_init(suffix, NULL, 0, 0);
-		return;
+int String_Builder_vappendf(String_Builder * builder, char const * format, va_list args) {
+	va_list again;
+	va_copy(again, args);
+	size_t room = String_Builder_room(builder);
+	String_BuilderChunk * last = builder->tail;
+	int n = vsnprintf(last ? last->data + last->used : NULL, last ? room + 1 : 0, format, args);
+	if (n < 0 || n > PTRDIFF_MAX - builder->size) {
+		va_end(again);
+		return -1;
 	}
-	ptrdiff_t N = str->size;
-	char first_sep = sep->str[0];
-	ptrdiff_t i = str->size - sep->size - 1;
-	char * str_ = str->str;
-	while (i > -1) {
-		if (!strncmp(str_ + i, sep->str, sep->size)) {
-			String_init(suffix, str_ + i + sep->size, N - i - sep->size, 0);
-			str->size = i;
-			return;
+	if ((size_t)n > room) {
+		// format again into a new chunk. the head of the text fills what was left of the last chunk
+		String_BuilderChunk * chunk = String_Builder_grow(builder, n);
+		if (!chunk || vsnprintf(chunk->data, n + 1, format, again) != n) {
+			if (chunk) { // unlink it again
+				String_BuilderChunk_free(builder, chunk);
+				builder->tail = last;
+				if (last) {
+					last->next = NULL;
+				} else {
+					builder->head = NULL;
+				}
+			}
+			va_end(again);
+			return -1;
 		}
-		i--;
-		while (i > -1 && str_[i] != first_sep) {
-			i--;
+		if (room) {
+			memcpy(last->data + last->used, chunk->data, room);
+			last->used += room;
+			memmove(chunk->data, chunk->data + room, n - room);
 		}
+		chunk->used = n - room;
+	} else {
+		last->used += n;
 	}
-	String_init(suffix, NULL, 0, 0);
+	va_end(again);
+	builder->size += n;
+	return n;
 }
-void String_copy(String * restrict dest, String const * restrict src) {
-	String_init(dest, src->str, src->size, 0);
+int String_Builder_appendf(String_Builder * builder, char const * format, ...) {
+	va_list args;
+	va_start(args, format);
+	int n = String_Builder_vappendf(builder, format, args);
+	va_end(args);
+	return n;
 }
-int String_expand_tabs(String * str, unsigned char tabsize) {
-	ptrdiff_t N = str->size;
-	if (N <= 0) {
+int String_Builder_build(String_Builder const * builder, String * dest) {
+	*dest = (String) {0};
+	if (!builder->size) {
 		return 0;
 	}
-	ptrdiff_t new_size = N;
-	char * str_ = str->str;
-	int ntab = 0;
-	for (ptrdiff_t i = 0; i < N; i++) {
-		if (str_[i] == '\t') {
-			new_size += tabsize - 1;
-			ntab++;
-		}
-	}
-	if (!ntab) {
-		return 0;
-	} else if ((size_t)new_size > str->capacity && !String_resize(str, new_size)) {
+	String_init(dest, NULL, 0, builder->size);
+	if (!dest->capacity) {
 		return -1;
 	}
-	// at this point, the str has sufficient capacity
-	str->size = new_size;
-	new_size--; // new_size is now the write pointer while N is the read
-	str_ = str->str; // reset in case realloc'd
-	N--;
-	while (N > -1) {
-		if (str_[N] == '\t') {
-			for (unsigned char i = 0; i < tabsize; i++) {
-				str_[new_size--] = ' ';
+	char * dest_ = String_data(dest);
+	for (String_BuilderChunk const * chunk = builder->head; chunk; chunk = chunk->next) {
+		memcpy(dest_ + String_len(dest), chunk->data, chunk->used);
+		String_set_len(dest, String_len(dest) + chunk->used);
+	}
+	return 0;
+}
+ptrdiff_t String_Builder_views(String_Builder const * builder, ptrdiff_t n, String * views) {
+	ptrdiff_t nchunks = 0;
+	for (String_BuilderChunk const * chunk = builder->head; chunk; chunk = chunk->next) {
+		if (chunk->used) {
+			if (nchunks < n) {
+				views[nchunks] = (String) {.str = (char *)chunk->data, .size = chunk->used};
 			}
-		} else {
-			str_[new_size--] = str_[N];
+			nchunks++;
 		}
-		N--;
 	}
-	return ntab;
+	return nchunks;
 }
-int String_append(String * str, char chr) {
-	if (str->size < 0 || (str->capacity == (size_t)str->size && 
-		!String_resize(str, STRING_GROWTH_FACTOR * str->capacity))) {
 
-		return -1;
+// String_Rope is an AVL tree whose leaves are Strings of at most STRING_ROPE_LEAF bytes. internal
+// nodes always have two children and hold the total size below them. trees are cut with split and
+// glued with join(left, node, right), which reuses the node it is given, so that split never 
+// allocates and edits only allocate before they change the tree. small edits stay within one leaf
+#define STRING_ROPE_LEAF 1024
+
+typedef struct String_RopeNode {
+	struct String_RopeNode * left; // NULL in a leaf
+	struct String_RopeNode * right;
+	ptrdiff_t size;
+	int height; // 1 for a leaf
+	String leaf;
+	String_Allocator const * allocator; // nodes of concatenated ropes may come from different ones
+} String_RopeNode;
+
+struct String_Rope {
+	String_Allocator const * allocator;
+	String_RopeNode * root;
+};
+
+static inline int String_RopeNode_height(String_RopeNode const * node) {
+	return node ? node->height : 0;
+}
+static void String_RopeNode_update(String_RopeNode * node) {
+	int hl = node->left->height;
+	int hr = node->right->height;
+	node->height = 1 + (hl > hr ? hl : hr);
+	node->size = node->left->size + node->right->size;
+}
+// gives back the memory of 'node' alone
+static void String_RopeNode_drop(String_RopeNode * node) {
+	if (node) {
+		String_obj_free(node->allocator, node, sizeof(*node));
 	}
-	// at this point, str has sufficient capacity
-	str->str[str->size++] = chr;
-	return 0;
 }
-int String_extend(String * restrict str, String const * restrict other) {
-	if (str->size < 0 || other->size < 0 || (str->capacity < (size_t)(str->size + other->size) && 
-		!String_resize(str, str->size + other->size))) {
-		
-		return -1;
+static void String_RopeNode_free(String_RopeNode * node) {
+	if (node) {
+		String_RopeNode_free(node->left);
+		String_RopeNode_free(node->right);
+		String_dest(&node->leaf);
+		String_RopeNode_drop(node);
 	}
-	// at this point, str has sufficient capacity
-	memcpy(str->str + str->size, other->str, other->size * sizeof(char));
-	str->size += other->size;
-	return 0;
 }
+static String_RopeNode * String_RopeNode_rotate_right(String_RopeNode * node) {
+	String_RopeNode * left = node->left;
+	node->left = left->right;
+	String_RopeNode_update(node);
+	left->right = node;
+	String_RopeNode_update(left);
+	return left;
+}
+static String_RopeNode * String_RopeNode_rotate_left(String_RopeNode * node) {
+	String_RopeNode * right = node->right;
+	node->right = right->left;
+	String_RopeNode_update(node);
+	right->left = node;
+	String_RopeNode_update(right);
+	return right;
+}
+static String_RopeNode * String_RopeNode_rebalance(String_RopeNode * node) {
+	String_RopeNode_update(node);
+	int balance = node->left->height - node->right->height;
+	if (balance > 1) {
+		if (String_RopeNode_height(node->left->left) < String_RopeNode_height(node->left->right)) {
+			node->left = String_RopeNode_rotate_left(node->left);
+		}
+		return String_RopeNode_rotate_right(node);
+	} else if (balance < -1) {
+		if (String_RopeNode_height(node->right->right) < String_RopeNode_height(node->right->left)) {
+			node->right = String_RopeNode_rotate_right(node->right);
+		}
+		return String_RopeNode_rotate_left(node);
+	}
+	return node;
+}
+// joins two trees with 'mid' as the new internal node, or frees 'mid' if it is not needed
+static String_RopeNode * String_Rope_join(String_RopeNode * left, String_RopeNode * mid, 
+	String_RopeNode * right) {
 
-// TODO: here
+	if (!left || !right) {
+		String_RopeNode_drop(mid);
+		return left ? left : right;
+	}
+	if (left->height > right->height + 1) {
+		left->right = String_Rope_join(left->right, mid, right);
+		return String_RopeNode_rebalance(left);
+	} else if (right->height > left->height + 1) {
+		right->left = String_Rope_join(left, mid, right->left);
+		return String_RopeNode_rebalance(right);
+	}
+	// two small leaves become one so that many edits do not fragment the rope
+	if (!left->left && !right->left && left->size + right->size <= STRING_ROPE_LEAF && 
+		!String_extend(&left->leaf, &right->leaf)) {
 
-int String_replace(String * str, String const * restrict old, 
-	String const * restrict new, int count) {
-	ptrdiff_t read = String_len(str);
-	ptrdiff_t old_size = String_len(old);
-	ptrdiff_t new_size = String_len(new);
+		left->size = String_len(&left->leaf);
+		String_RopeNode_free(right);
+		String_RopeNode_drop(mid);
+		return left;
+	}
+	*mid = (String_RopeNode) {.left = left, .right = right, .allocator = mid->allocator};
+	String_RopeNode_update(mid);
+	return mid;
+}
+// cuts the tree into [0, loc) and [loc, size). a leaf that has to be cut gives its tail to the 
+// leaf in *spare, which must have room for STRING_ROPE_LEAF bytes and is then set to NULL
+static void String_Rope_split_(String_RopeNode * node, ptrdiff_t loc, String_RopeNode ** spare, 
+	String_RopeNode ** left, String_RopeNode ** right) {
 
-	int nold = String_count(str, old, 0, read);
-	if (!nold) {
-		return 0;
+	if (!node || loc <= 0) {
+		*left = NULL;
+		*right = node;
+		return;
+	} else if (loc >= node->size) {
+		*left = node;
+		*right = NULL;
+		return;
 	}
-	if (!count) {
-		count = nold;
+	if (!node->left) {
+		String_RopeNode * tail = *spare;
+		*spare = NULL;
+		String_extend(&tail->leaf, &(String){.str = String_data(&node->leaf) + loc, 
+			.size = node->size - loc});
+		String_shrink_to_fit(&tail->leaf);
+		tail->size = String_len(&tail->leaf);
+		String_set_len(&node->leaf, loc);
+		node->size = loc;
+		*left = node;
+		*right = tail;
+		return;
 	}
-	ptrdiff_t delta = count * (new_size - old_size);
-
-	ptrdiff_t write = read + delta;
-	if ((size_t)write > String_capacity(str) && !String_resize(str, write)) {
-		return -1;
+	String_RopeNode * l = node->left;
+	String_RopeNode * r = node->right;
+	String_RopeNode * cut = NULL;
+	if (loc < l->size) {
+		String_Rope_split_(l, loc, spare, left, &cut);
+		*right = String_Rope_join(cut, node, r);
+	} else {
+		String_Rope_split_(r, loc - l->size, spare, &cut, right);
+		*left = String_Rope_join(l, node, cut);
 	}
-	// str should have sufficient capacity
-	// write; // this is now the location before which bytes are being written to
-	// read; // this is now the location before which bytes are read from
-	ptrdiff_t next = read;
-	for (int i = 0; i < nold - count; i++) {
-		next = String_rfind(str, old, 0, next);
+}
+// an empty leaf, or an internal node once it is joined
+static String_RopeNode * String_RopeNode_new(String_Allocator const * allocator) {
+	String_RopeNode * node = String_obj_calloc(allocator, 1, sizeof(*node));
+	if (node) {
+		node->height = 1;
+		node->allocator = allocator;
+	}
+	return node;
+}
+// a leaf with room for the tail of any leaf, for String_Rope_split_
+static String_RopeNode * String_RopeNode_spare(String_Allocator const * allocator) {
+	String_RopeNode * node = String_RopeNode_new(allocator);
+	if (node) {
+		String_init_with(&node->leaf, allocator, NULL, 0, STRING_ROPE_LEAF);
+		if (!node->leaf.capacity) {
+			String_RopeNode_drop(node);
+			return NULL;
+		}
 	}
-	write -= read - next;
-	memmove(str->str + write, str->str + next, (read - next) * sizeof(char));
-	read = next;
-	for (int i = 0; i < count; i++) {
-		next = String_rfind(str, old, 0, next);
-		ptrdiff_t copy = read - next - old_size;
-
-		// copy everything up to next instance of old string to new buffer
-		write -= copy;
-		memmove(str->str + write, str->str + next + old_size, copy * sizeof(char));
+	return node;
+}
+// a balanced tree of the n bytes in buf. returns NULL on allocation failure
+static String_RopeNode * String_Rope_build(String_Allocator const * allocator, char const * buf, 
+	ptrdiff_t n) {
 
-		// copy in new string where old was to be placed
-		write -= new_size;
-		memcpy(str->str + write, new->str, new_size * sizeof(char));
-		read = next;
+	String_RopeNode * node = String_RopeNode_new(allocator);
+	if (!node) {
+		return NULL;
+	}
+	if (n <= STRING_ROPE_LEAF) {
+		String_init_with(&node->leaf, allocator, buf, n, 0);
+		if (!node->leaf.capacity) {
+			String_RopeNode_drop(node);
+			return NULL;
+		}
+		node->size = n;
+		return node;
+	}
+	ptrdiff_t nleaves = (n + STRING_ROPE_LEAF - 1) / STRING_ROPE_LEAF;
+	ptrdiff_t half = nleaves / 2 * STRING_ROPE_LEAF;
+	node->left = String_Rope_build(allocator, buf, half);
+	node->right = node->left ? String_Rope_build(allocator, buf + half, n - half) : NULL;
+	if (!node->right) {
+		String_RopeNode_free(node);
+		return NULL;
+	}
+	String_RopeNode_update(node);
+	return node;
+}
+// the leaf holding byte 'pos', which becomes the offset in the leaf. pos == size gives the end of
+// the last leaf
+static String_RopeNode * String_Rope_leaf(String_RopeNode * node, ptrdiff_t * pos) {
+	while (node->left) {
+		if (*pos < node->left->size) {
+			node = node->left;
+		} else {
+			*pos -= node->left->size;
+			node = node->right;
+		}
+	}
+	return node;
+}
+// adds 'delta' to the sizes on the path to byte 'pos'
+static void String_Rope_resize_path(String_RopeNode * node, ptrdiff_t pos, ptrdiff_t delta) {
+	while (node) {
+		node->size += delta;
+		if (!node->left) {
+			String_set_len(&node->leaf, String_len(&node->leaf) + delta);
+			return;
+		}
+		if (pos < node->left->size) {
+			node = node->left;
+		} else {
+			pos -= node->left->size;
+			node = node->right;
+		}
+	}
+}
+// copies the n bytes from 'pos' to buf
+static void String_Rope_read(String_Rope const * rope, ptrdiff_t pos, ptrdiff_t n, char * buf) {
+	String chunk;
+	while (n > 0 && String_Rope_next(rope, &pos, &chunk)) {
+		ptrdiff_t take = String_len(&chunk) < n ? String_len(&chunk) : n;
+		memcpy(buf, String_data(&chunk), take);
+		buf += take;
+		n -= take;
 	}
-
-	return count;
 }
 
-// allocates upon return
-String * String_new(char const * buf, size_t size, size_t capacity) {
-	String * str = malloc(sizeof(*str));
-	if (!str) {
+String_Rope * String_Rope_new(String const * str) {
+	String_Allocator const * allocator = String_default_allocator();
+	String_Rope * rope = String_obj_calloc(allocator, 1, sizeof(*rope));
+	if (!rope) {
 		return NULL;
 	}
-	*str = (String){0};
-	String_init(str, buf, size, capacity);
-	return str;
+	rope->allocator = allocator;
+	if (str && String_len(str) > 0) {
+		rope->root = String_Rope_build(allocator, String_data(str), String_len(str));
+		if (!rope->root) {
+			String_obj_free(allocator, rope, sizeof(*rope));
+			return NULL;
+		}
+	}
+	return rope;
 }
-// separate on whitespace if sep is NULL. Returns number of elements of dest filled
-ptrdiff_t String_split(ptrdiff_t nsplit, String * restrict dest, String * restrict str, String * restrict sep) {
-	ptrdiff_t N = String_len(str);
-
-	if (nsplit < 1) {
-		return -1;
+void String_Rope_del(String_Rope * rope) {
+	if (rope) {
+		String_RopeNode_free(rope->root);
+		String_obj_free(rope->allocator, rope, sizeof(*rope));
 	}
-
-	ptrdiff_t sep_size = String_len(sep);
-	ptrdiff_t start = 0;
-	ptrdiff_t loc = String_find(str, sep, start, N);	
-	ptrdiff_t j = 0;
-	while (j < nsplit && loc >= 0) {
-		String_init(dest + j++, str->str + start, loc - start, 0);
-		start = loc + sep_size;
-		loc = String_find(str, sep, start, N);
+}
+ptrdiff_t String_Rope_len(String_Rope const * rope) {
+	return rope->root ? rope->root->size : 0;
+}
+char String_Rope_get(String_Rope const * rope, ptrdiff_t loc) {
+	ptrdiff_t size = String_Rope_len(rope);
+	if (size <= 0) {
+		return '\0';
 	}
-	if (j < nsplit && start < N) {
-		String_init(dest + j++, str->str + start, N - start, 0);
+	if (loc < 0) {
+		loc = size - 1 + ((loc + 1) % size);
 	}
-	return j;
+	if (loc < size) {
+		String_RopeNode * leaf = String_Rope_leaf(rope->root, &loc);
+		return String_data(&leaf->leaf)[loc];
+	}
+	return '\0';
 }
-int String_join(String * restrict dest, String const * restrict sep, ptrdiff_t n, 
-	String const * const restrict strings) {
-
-	if (!n) {
+int String_Rope_insert(String_Rope * rope, ptrdiff_t loc, String const * str) {
+	ptrdiff_t size = String_Rope_len(rope);
+	if (loc < 0 || loc > size || String_len(str) < 0 || String_len(str) > PTRDIFF_MAX - size) {
 		return -1;
+	} else if (!String_len(str)) {
+		return 0;
 	}
-
-	if (!sep) {
-		sep = &EMPTY_STRING;
+	if (rope->root) { // fits in the leaf it goes into
+		ptrdiff_t offset = loc;
+		String_RopeNode * leaf = String_Rope_leaf(rope->root, &offset);
+		if (leaf->size + String_len(str) <= STRING_ROPE_LEAF) {
+			if (String_reserve(&leaf->leaf, STRING_ROPE_LEAF)) {
+				return -1;
+			}
+			char * leaf_ = String_data(&leaf->leaf);
+			memmove(leaf_ + offset + String_len(str), leaf_ + offset, leaf->size - offset);
+			memcpy(leaf_ + offset, String_data(str), String_len(str));
+			String_Rope_resize_path(rope->root, loc, String_len(str));
+			return 0;
+		}
 	}
-	
-	ptrdiff_t sep_size = String_len(sep);
-	ptrdiff_t min_size = (n - 1) * sep_size;
-	for (ptrdiff_t i = 0; i < n; i++) {
-		min_size += String_len(strings + i);
+	String_RopeNode * tree = String_Rope_build(rope->allocator, String_data(str), String_len(str));
+	String_RopeNode * spare = String_RopeNode_spare(rope->allocator);
+	String_RopeNode * mid1 = String_RopeNode_new(rope->allocator);
+	String_RopeNode * mid2 = String_RopeNode_new(rope->allocator);
+	if (!tree || !spare || !mid1 || !mid2) {
+		String_RopeNode_free(tree);
+		String_RopeNode_free(spare);
+		String_RopeNode_drop(mid1);
+		String_RopeNode_drop(mid2);
+		return -1;
 	}
-	if (!String_resize(dest, min_size)) {
+	String_RopeNode * left;
+	String_RopeNode * right;
+	String_Rope_split_(rope->root, loc, &spare, &left, &right);
+	String_RopeNode_free(spare);
+	rope->root = String_Rope_join(String_Rope_join(left, mid1, tree), mid2, right);
+	return 0;
+}
+int String_Rope_erase(String_Rope * rope, ptrdiff_t start, ptrdiff_t end) {
+	if (start < 0 || end < start || end > String_Rope_len(rope)) {
 		return -1;
+	} else if (start == end) {
+		return 0;
 	}
-	String_clear(dest);
-	String_extend(dest, strings + 0);
-	for (ptrdiff_t j = 1; j < n; j++) {
-		String_extend(dest, sep);
-		String_extend(dest, strings + j);
+	ptrdiff_t offset = start;
+	String_RopeNode * leaf = String_Rope_leaf(rope->root, &offset);
+	if (offset + (end - start) < leaf->size) { // within one leaf, which keeps some bytes
+		char * leaf_ = String_data(&leaf->leaf);
+		memmove(leaf_ + offset, leaf_ + offset + (end - start), leaf->size - offset - (end - start));
+		String_Rope_resize_path(rope->root, start, start - end);
+		return 0;
+	}
+	String_RopeNode * spare1 = String_RopeNode_spare(rope->allocator);
+	String_RopeNode * spare2 = String_RopeNode_spare(rope->allocator);
+	String_RopeNode * mid = String_RopeNode_new(rope->allocator);
+	if (!spare1 || !spare2 || !mid) {
+		String_RopeNode_free(spare1);
+		String_RopeNode_free(spare2);
+		String_RopeNode_drop(mid);
+		return -1;
 	}
+	String_RopeNode * head;
+	String_RopeNode * cut;
+	String_RopeNode * tail;
+	String_Rope_split_(rope->root, end, &spare1, &head, &tail);
+	String_Rope_split_(head, start, &spare2, &head, &cut);
+	String_RopeNode_free(cut);
+	String_RopeNode_free(spare1);
+	String_RopeNode_free(spare2);
+	rope->root = String_Rope_join(head, mid, tail);
 	return 0;
 }
-char * String_cstr(String * str) {
-	if (String_append(str, '\0') < 0) {
-		return NULL;
+int String_Rope_concat(String_Rope * rope, String_Rope * other) {
+	String_RopeNode * mid = String_RopeNode_new(rope->allocator);
+	if (!mid) {
+		return -1;
 	}
-	str->size--; // the null-terminator that was append is not part of the string itself
-	return str->str;
+	rope->root = String_Rope_join(rope->root, mid, other->root);
+	String_obj_free(other->allocator, other, sizeof(*other));
+	return 0;
 }
-
-int String_slice(String * restrict dest, String const * restrict str, ptrdiff_t start, ptrdiff_t end, ptrdiff_t step) {
-	if (step == 0) {
-		step = 1;
+String_Rope * String_Rope_split(String_Rope * rope, ptrdiff_t loc) {
+	if (loc < 0 || loc > String_Rope_len(rope)) {
+		return NULL;
 	}
-	ptrdiff_t N = String_len(str);
-	int dir = step > 0 ? 1 : -1;
-	if (dir > 0 && end == 0) {
-		end = N;
+	String_Rope * rest = String_obj_calloc(rope->allocator, 1, sizeof(*rest));
+	String_RopeNode * spare = String_RopeNode_spare(rope->allocator);
+	if (!rest || !spare) {
+		String_RopeNode_free(spare);
+		String_obj_free(rope->allocator, rest, sizeof(*rest));
+		return NULL;
 	}
-	if (start < 0) {
-		start = N - 1 + ((start + 1) % N);
+	rest->allocator = rope->allocator;
+	String_Rope_split_(rope->root, loc, &spare, &rope->root, &rest->root);
+	String_RopeNode_free(spare);
+	return rest;
+}
+_Bool String_Rope_next(String_Rope const * rope, ptrdiff_t * pos, String * chunk) {
+	if (*pos < 0 || *pos >= String_Rope_len(rope)) {
+		return false;
 	}
-	if (end < 0) {
-		end = N + ((end + 1) % N);
+	ptrdiff_t offset = *pos;
+	String_RopeNode * leaf = String_Rope_leaf(rope->root, &offset);
+	*chunk = (String) {.str = String_data(&leaf->leaf) + offset, .size = leaf->size - offset};
+	*pos += String_len(chunk);
+	return true;
+}
+int String_Rope_copy(String_Rope const * rope, ptrdiff_t start, ptrdiff_t end, String * dest) {
+	*dest = (String) {0};
+	ptrdiff_t size = String_Rope_len(rope);
+	if (!size || !String_range(&(String) {.size = size}, &start, &end)) {
+		return 0;
 	}
-	// special case of end originally being -1
-	if (dir < 0) {
-		if (end == N) {
-			end = -1;
+	String_init(dest, NULL, 0, end - start);
+	if (!dest->capacity) {
+		return -1;
+	}
+	String_Rope_read(rope, start, end - start, String_data(dest));
+	String_set_len(dest, end - start);
+	return 0;
+}
+// searches rope[start:end] for tw's needle through a window that keeps the last m - 1 bytes of each
+// fill, so that matches spanning leaves are seen without flattening the range. the window holds at 
+// least m new bytes per fill, which keeps the scan linear for needles longer than a leaf. returns 
+// the first match, or if 'count' is not NULL adds up the non-overlapping matches and returns -1. 
+// returns -2 on allocation failure
+static ptrdiff_t String_Rope_scan(String_Rope const * rope, String_TwoWay const * tw, 
+	ptrdiff_t start, ptrdiff_t end, int * count) {
+
+	ptrdiff_t const m = tw->size;
+	char stack[2 * STRING_ROPE_LEAF];
+	ptrdiff_t const cap = 2 * (m > STRING_ROPE_LEAF ? m : STRING_ROPE_LEAF);
+	char * window = cap > (ptrdiff_t)sizeof(stack) ? String_obj_alloc(rope->allocator, cap) : stack;
+	if (!window) {
+		return -2;
+	}
+	ptrdiff_t result = -1;
+	ptrdiff_t pos = start; // the window holds rope[pos:pos + len]
+	ptrdiff_t len = 0;
+	ptrdiff_t skip = 0; // the window bytes already covered by a counted match
+	for (;;) {
+		ptrdiff_t fill = cap - len < end - pos - len ? cap - len : end - pos - len;
+		String_Rope_read(rope, pos + len, fill, window + len);
+		len += fill;
+		ptrdiff_t loc;
+		while (skip <= len - m && (loc = STRING_KERNEL(String_find_kernel)(tw, window + skip, 
+			len - skip)) >= 0) {
+
+			if (!count) {
+				result = pos + skip + loc;
+				goto done;
+			}
+			++*count;
+			skip += loc + m;
+		}
+		if (pos + len >= end) {
+			break;
 		}
+		// keep the bytes a later match could still start in
+		ptrdiff_t keep = len - skip < m - 1 ? len - skip : m - 1;
+		memmove(window, window + len - keep, keep);
+		pos += len - keep;
+		skip = 0;
+		len = keep;
 	}
-	if ((dir < 0 && end >= start) || (dir > 0 && end <= start)) {
-		return -1;
+done:
+	if (window != stack) {
+		String_obj_free(rope->allocator, window, cap);
 	}
-	
-	size_t nchars = (end - start - dir) / step + 1;
-	String_resize(dest, nchars);
-	String_clear(dest);
-	if (!dest->str) {
+	return result;
+}
+ptrdiff_t String_Rope_find(String_Rope const * rope, String const * sub, ptrdiff_t start, 
+	ptrdiff_t end) {
+
+	ptrdiff_t size = String_Rope_len(rope);
+	if (String_len(sub) <= 0 || !size || !String_range(&(String) {.size = size}, &start, &end) || 
+		end - start < String_len(sub)) {
+
 		return -1;
 	}
-	char const * str_ = str->str;
-	for ( ; 0 < (end - start) * dir; start += step) {
-		if (String_append(dest, str_[start])) {
-			String_del(dest);
-			return -1;
+	String_TwoWay tw;
+	String_two_way_init(&tw, sub);
+	ptrdiff_t loc = String_Rope_scan(rope, &tw, start, end, NULL);
+	return loc < 0 ? -1 : loc;
+}
+int String_Rope_count(String_Rope const * rope, String const * sub, ptrdiff_t start, ptrdiff_t end) {
+	ptrdiff_t size = String_Rope_len(rope);
+	if (String_len(sub) <= 0 || !size || !String_range(&(String) {.size = size}, &start, &end) || 
+		end - start < String_len(sub)) {
+
+		return 0;
+	}
+	String_TwoWay tw;
+	String_two_way_init(&tw, sub);
+	int count = 0;
+	return String_Rope_scan(rope, &tw, start, end, &count) == -2 ? -1 : count;
+}
+
+static _Bool String_simd_supported(int level) {
+	switch (level) {
+		case STRING_SIMD_SCALAR:
+			return true;
+#ifdef STRING_X86
+		case STRING_SIMD_SSE2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		case STRING_SIMD_SSSE3:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("ssse3");
+		case STRING_SIMD_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+	}
+	return false;
+}
+
+// the whole set is chosen before any of it is published, so threads that resolve the kernels at the
+// same time only ever store the final ones
+static void String_simd_apply(int level) {
+	String_FindKernel find = String_two_way_find;
+	String_SpanKernel span = String_span_scalar;
+	String_SpanKernel rspan = String_rspan_scalar;
+	String_SpanKernel ws_span = String_span_scalar;
+	String_SpanKernel ws_rspan = String_rspan_scalar;
+	String_TranslateKernel translate = String_translate_scalar;
+	String_CaseKernel case_ = String_case_swar;
+	String_MismatchKernel mismatch = String_mismatch_word;
+#ifdef STRING_X86
+	if (level >= STRING_SIMD_SSE2) {
+		mismatch = String_mismatch_sse2;
+		case_ = String_case_sse2;
+		find = String_find_sse2;
+		ws_span = String_ws_span_sse2;
+		ws_rspan = String_ws_rspan_sse2;
+	}
+	if (level >= STRING_SIMD_SSSE3) {
+		span = String_span_ssse3;
+		rspan = String_rspan_ssse3;
+		translate = String_translate_ssse3;
+	}
+	if (level >= STRING_SIMD_AVX2) {
+		find = String_find_avx2;
+		span = String_span_avx2;
+		rspan = String_rspan_avx2;
+		ws_span = String_ws_span_avx2;
+		ws_rspan = String_ws_rspan_avx2;
+		translate = String_translate_avx2;
+		case_ = String_case_avx2;
+		mismatch = String_mismatch_avx2;
+	}
+#endif
+	STRING_ATOMIC_STORE(&String_find_kernel, find);
+	STRING_ATOMIC_STORE(&String_span_kernel, span);
+	STRING_ATOMIC_STORE(&String_rspan_kernel, rspan);
+	STRING_ATOMIC_STORE(&String_ws_span_kernel, ws_span);
+	STRING_ATOMIC_STORE(&String_ws_rspan_kernel, ws_rspan);
+	STRING_ATOMIC_STORE(&String_translate_kernel, translate);
+	STRING_ATOMIC_STORE(&String_case_kernel, case_);
+	STRING_ATOMIC_STORE(&String_mismatch_kernel, mismatch);
+	STRING_ATOMIC_STORE(&String_simd, level);
+}
+
+int String_simd_select(char const * level) {
+	if (!level) {
+		level = getenv("STRINGS_SIMD");
+	}
+	if (level && *level) {
+		for (int i = 0; i < STRING_SIMD_COUNT; i++) {
+			if (!strcmp(level, String_simd_names[i]) && String_simd_supported(i)) {
+				String_simd_apply(i);
+				return 0;
+			}
 		}
 	}
-	return 0;
+	int best = STRING_SIMD_COUNT - 1;
+	while (!String_simd_supported(best)) {
+		best--;
+	}
+	String_simd_apply(best);
+	return level && *level ? -1 : 0;
+}
+
+char const * String_simd_level(void) {
+	if (STRING_ATOMIC_LOAD(&String_simd) < 0) {
+		String_simd_select(NULL);
+	}
+	return String_simd_names[STRING_ATOMIC_LOAD(&String_simd)];
+}
+
+static ptrdiff_t String_find_resolve(String_TwoWay const * tw, char const * hay, ptrdiff_t size) {
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_find_kernel)(tw, hay, size);
+}
+static ptrdiff_t String_span_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_span_kernel)(set, s, n, accept);
+}
+static ptrdiff_t String_rspan_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_rspan_kernel)(set, s, n, accept);
+}
+static ptrdiff_t String_ws_span_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_ws_span_kernel)(set, s, n, accept);
+}
+static ptrdiff_t String_ws_rspan_resolve(String_CharSet const * set, char const * s, ptrdiff_t n, 
+	_Bool accept) {
+
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_ws_rspan_kernel)(set, s, n, accept);
+}
+static ptrdiff_t String_translate_resolve(unsigned char const * table, String_CharSet const * drop,
+	char * dst, char const * src, ptrdiff_t n) {
+
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_translate_kernel)(table, drop, dst, src, n);
+}
+static void String_case_resolve(char * dst, char const * src, ptrdiff_t n, char first) {
+	String_simd_select(NULL);
+	STRING_KERNEL(String_case_kernel)(dst, src, n, first);
+}
+static ptrdiff_t String_mismatch_resolve(char const * a, char const * b, ptrdiff_t n) {
+	String_simd_select(NULL);
+	return STRING_KERNEL(String_mismatch_kernel)(a, b, n);
 }
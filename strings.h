@@ -1,6 +1,11 @@
 #ifndef STRINGS_H
 #define STRINGS_H
 
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
 // WARNING: except where otherwise noted, all pointers passed should be non-null
 
 #ifndef STRING_GROWTH_FACTOR
@@ -13,15 +18,145 @@ typedef struct String {
 	size_t capacity; // 0 means not allocated or reallocatable. number of elements allocated
 } String;
 
+// strings owned by the library that need at most STRING_SSO_CAPACITY bytes are kept inline: their 
+// bytes fill the String and its last byte holds STRING_SSO_FLAG and their length. 'str' and 'size' 
+// are meaningful for views and buffers but not for inline strings, so read any String that may be 
+// owned with String_data, String_len and String_capacity
+#define STRING_SSO_FLAG (~(~(size_t)0 >> 1))
+// the length shares the last byte of 'capacity' with the flag, so inline storage needs a 
+// little-endian layout
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && \
+	defined(__SIZEOF_POINTER__) && __SIZEOF_POINTER__ == __SIZEOF_SIZE_T__
+	#define STRING_SSO_CAPACITY (sizeof(String) - 1)
+#else
+	#define STRING_SSO_CAPACITY 0
+#endif
+#define STRING_SSO_SHIFT ((sizeof(size_t) - 1) * CHAR_BIT)
+
 extern String const WHITESPACE;
 
+// a set of bytes as a 256-bit bitmap. build with String_CharSet_init; the layout is internal
+typedef struct String_CharSet {
+	unsigned char bits[32];
+} String_CharSet;
+
+// the same characters as WHITESPACE
+extern String_CharSet const WHITESPACE_SET;
+
+void String_CharSet_init(String_CharSet * set, String const * chars);
+static inline _Bool String_CharSet_has(String_CharSet const * set, char c) {
+	unsigned char u = (unsigned char)c;
+	return (set->bits[(u >> 7) << 4 | (u & 15)] >> ((u >> 4) & 7)) & 1;
+}
+
 #define String_size(str) String_len(str)
-static inline ptrdiff_t String_len(String const * str) { return str->size; }
-static inline size_t String_capacity(String const * str) { return str->capacity; }
+static inline _Bool String_is_inline(String const * str) {
+	return STRING_SSO_CAPACITY && (str->capacity & STRING_SSO_FLAG);
+}
+static inline ptrdiff_t String_len(String const * str) {
+	return String_is_inline(str) ? (ptrdiff_t)((str->capacity & ~STRING_SSO_FLAG) >> STRING_SSO_SHIFT) : 
+		str->size;
+}
+// set in the capacity of strings that share a buffer through String_share
+#define STRING_SHARED_FLAG (STRING_SSO_FLAG >> 1)
+static inline _Bool String_is_shared(String const * str) {
+	return (str->capacity & (STRING_SSO_FLAG | STRING_SHARED_FLAG)) == STRING_SHARED_FLAG;
+}
+// set in the capacity of strings whose buffer comes from a String_Allocator other than malloc. a 
+// String may also be filled in by hand with a buffer from malloc and its size as the capacity, which
+// is then grown with realloc and freed with free. capacities must be at most STRING_CAPACITY_MAX
+#define STRING_ALLOCATOR_FLAG (STRING_SHARED_FLAG >> 1)
+#define STRING_CAPACITY_MAX (STRING_ALLOCATOR_FLAG - 1)
+// the bytes of 'str'. for an inline string these are the String itself, so the pointer and any view 
+// of it are only valid while the String stays where it is
+static inline char * String_data(String const * str) {
+	return String_is_inline(str) ? (char *)str : str->str;
+}
+// the number of chars that can be written in place: 0 for views and shared strings
+static inline size_t String_capacity(String const * str) {
+	return String_is_inline(str) ? STRING_SSO_CAPACITY : String_is_shared(str) ? 0 : 
+		str->capacity & ~STRING_ALLOCATOR_FLAG;
+}
 
 _Bool String_is_empty(String const * str);
 void String_clear(String * str);
+// orders by unsigned bytes and then by size. embedded nulls are compared like any other byte
 int String_compare(String const * a, String const * b);
+// faster than String_compare when only equality is needed
+_Bool String_equal(String const * a, String const * b);
+// returns the number of leading bytes that a and b have in common
+ptrdiff_t String_common_prefix_len(String const * a, String const * b);
+
+// 64-bit non-cryptographic hash (wyhash). the same bytes and seed always give the same hash on a 
+// given platform, but values differ between little- and big-endian machines
+uint64_t String_hash(String const * str, uint64_t seed);
+// a String view paired with its hash so that repeated lookups do not rehash. 'str' is not copied
+typedef struct String_Hashed {
+	String str;
+	uint64_t hash;
+} String_Hashed;
+void String_Hashed_init(String_Hashed * key, String const * str, uint64_t seed);
+// compares the cached hashes before the bytes. both keys must have been hashed with the same seed
+_Bool String_Hashed_equal(String_Hashed const * a, String_Hashed const * b);
+
+// a hash map from String keys to values of a fixed size. keys are views: the map does not copy their
+// bytes, which must outlive the entry. value pointers are invalidated by the next put, remove or 
+// rehash. each map hashes with a seed of its own, so iteration orders differ between maps
+typedef struct String_Map String_Map;
+// 'n' is the number of entries to reserve space for. value_size may be 0 to make a set
+String_Map * String_Map_new(size_t value_size, ptrdiff_t n);
+void String_Map_del(String_Map * map);
+ptrdiff_t String_Map_len(String_Map const * map);
+// ensures that n entries fit without rehashing. returns -1 on allocation failure
+int String_Map_reserve(String_Map * map, ptrdiff_t n);
+// rebuilds the table for n entries (at least the current number), growing or shrinking it
+int String_Map_rehash(String_Map * map, ptrdiff_t n);
+// returns a pointer to the value of 'key' or NULL if it is not in the map
+void * String_Map_get(String_Map const * map, String const * key);
+// returns a pointer to the value of 'key', inserting it with a zeroed value if it is not in the map.
+// 'inserted' (if not NULL) tells which. returns NULL on allocation failure
+void * String_Map_put(String_Map * map, String const * key, _Bool * inserted);
+// copies the value of 'key' to 'value' (if not NULL) and removes it. returns false if not found
+_Bool String_Map_remove(String_Map * map, String const * key, void * value);
+// iterates over the entries in no particular order. start with *iter = 0. key and value may be NULL
+_Bool String_Map_next(String_Map const * map, ptrdiff_t * iter, String * key, void ** value);
+
+// a pool of unique strings. interning equal contents gives handles with the same String_data 
+// pointer, so interned strings compare equal iff their pointers are equal (String_interned_equal) 
+// and can be hashed by address. handles are views (capacity 0) of null-terminated bytes owned by the
+// pool, which never move and stay valid until String_Intern_del
+typedef struct String_Intern String_Intern;
+String_Intern * String_Intern_new(void);
+void String_Intern_del(String_Intern * pool);
+// the number of unique strings in the pool
+ptrdiff_t String_Intern_len(String_Intern const * pool);
+// writes the canonical handle of 'str' to 'handle', copying 'str' into the pool if it is new. 
+// returns -1 on allocation failure
+int String_intern(String_Intern * pool, String const * str, String * handle);
+// as String_intern but never adds to the pool. returns false if 'str' was not interned
+_Bool String_Intern_find(String_Intern const * pool, String const * str, String * handle);
+static inline _Bool String_interned_equal(String const * a, String const * b) {
+	return a->str == b->str;
+}
+
+// a String_Intern that many threads can use at once. lookups never block or retry and handles never
+// move. each thread copies strings into its own arena, obtained once from 
+// String_ConcurrentIntern_arena and used by that thread only. handles are valid until 
+// String_ConcurrentIntern_del, which must not run concurrently with anything else. without GNU 
+// atomic builtins the pool is not thread-safe
+typedef struct String_ConcurrentIntern String_ConcurrentIntern;
+typedef struct String_InternArena String_InternArena;
+// 'n' is the expected number of unique strings
+String_ConcurrentIntern * String_ConcurrentIntern_new(ptrdiff_t n);
+void String_ConcurrentIntern_del(String_ConcurrentIntern * pool);
+// returns a new arena owned by the pool or NULL on allocation failure
+String_InternArena * String_ConcurrentIntern_arena(String_ConcurrentIntern * pool);
+ptrdiff_t String_ConcurrentIntern_len(String_ConcurrentIntern const * pool);
+// as String_intern. new strings are copied into 'arena'
+int String_ConcurrentIntern_add(String_ConcurrentIntern * pool, String_InternArena * arena, 
+	String const * str, String * handle);
+_Bool String_ConcurrentIntern_find(String_ConcurrentIntern const * pool, String const * str, 
+	String * handle);
 // this is for compatibility with e.g. qsort. cannot be a macro because I need the address
 static inline int String_comp(void const * a, void const * b) {
 	return String_compare((String *)a, (String *)b);
@@ -30,6 +165,19 @@ _Bool String_in(String const * str, String const * restrict other);
 _Bool String_char_in(String const * str, char val);
 void String_lower(String * str);
 void String_upper(String * str);
+// as String_lower and String_upper but write the result into 'dest', reusing its buffer if it owns
+// one. 'dest' must be destroyed. return -1 on allocation failure
+int String_lower_into(String * restrict dest, String const * restrict src);
+int String_upper_into(String * restrict dest, String const * restrict src);
+// fills the 256-entry 'table' with the identity map and then maps from[i] to to[i] for each i in 
+// the shorter of the two
+void String_maketrans(unsigned char * table, String const * from, String const * to);
+// maps every byte through the 256-entry 'table' and removes the bytes in 'drop'. either may be NULL
+void String_translate(String * str, unsigned char const * table, String_CharSet const * drop);
+// as String_translate but writes the result into 'dest', reusing its buffer if it owns one. 'dest' 
+// must be destroyed. returns -1 on allocation failure
+int String_translate_into(String * restrict dest, String const * restrict src, 
+	unsigned char const * table, String_CharSet const * drop);
 // can "fail". returns 0
 char String_get(String const * str, ptrdiff_t loc);
 // can "fail". returns 0
@@ -39,41 +187,241 @@ _Bool String_ends_with(String const * restrict str, String const * restrict suff
 int String_count(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end);
 // can "fail". returns -1
 ptrdiff_t String_find(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end);
+// writes the locations of up to n matches in order to 'locs' and returns the number written. matches
+// may overlap if 'overlap'. if n are returned, continue from start = locs[n - 1] + 1 (overlap) or 
+// locs[n - 1] + String_len(sub)
+ptrdiff_t String_find_all(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end, 
+	_Bool overlap, ptrdiff_t * locs, ptrdiff_t n);
 // can "fail". returns -1
 ptrdiff_t String_rfind(String const * str, String const * sub, ptrdiff_t start, ptrdiff_t end);
 void String_dest(String * str); // frees buffer only and resets. To use reallocatable methods, must have subsequent String_init() call
-void String_del(String * str); // calls *_dest and then frees str
+void String_del(String * str); // calls *_dest and then frees str, which must come from malloc
 void String_strip(String * str, String const * restrict chars); // whitespace if chars == NULL
 void String_lstrip(String * str, String const * restrict chars); // whitespace if chars == NULL
 void String_rstrip(String * str, String const * restrict chars); // whitespace if chars == NULL
+void String_strip_set(String * str, String_CharSet const * set);
+void String_lstrip_set(String * str, String_CharSet const * set);
+void String_rstrip_set(String * str, String_CharSet const * set);
+// the length of the longest prefix of bytes in 'set'
+ptrdiff_t String_span(String const * str, String_CharSet const * set);
+// the length of the longest prefix of bytes not in 'set'
+ptrdiff_t String_cspan(String const * str, String_CharSet const * set);
+// the length of the longest suffix of bytes in 'set'
+ptrdiff_t String_rspan(String const * str, String_CharSet const * set);
 
 // can fail if target string does not have large enough size or will reallocate underlying 
 // buffer. failures are negative returns or null strings
 
 // if any non-'str', non-zero arguments are provided, 'str' must be destroyed
 void String_init(String * restrict str, char const * restrict buf, ptrdiff_t size, size_t capacity);
+
+// where String memory comes from. sizes include a pointer-sized header that strings.c puts in front 
+// of each buffer. realloc may be NULL to allocate, copy and free instead, and free may be NULL if memory is 
+// released some other way. ctx is passed to every call. patterns, maps, intern pools, builders and 
+// ropes take all their memory from the allocator in use when they are made and keep it, so a 
+// String_ConcurrentIntern calls it from every thread that adds to the pool. only the String of 
+// String_new and the blocks of a String_Arena always come from malloc
+typedef struct String_Allocator {
+	void * (*alloc)(void * ctx, size_t size);
+	void * (*realloc)(void * ctx, void * p, size_t old_size, size_t size);
+	void (*free)(void * ctx, void * p, size_t size);
+	void * ctx;
+} String_Allocator;
+// sets the allocator of every new buffer in the process. NULL restores malloc. returns the previous
+// allocator. the allocator must outlive every buffer it allocates. other threads may be using the 
+// library: buffers keep the allocator they were made with and new ones use the new allocator
+String_Allocator const * String_Allocator_set(String_Allocator const * allocator);
+// overrides the process allocator in this thread until called again, e.g. for one operation. NULL
+// ends the override. returns the previous override
+String_Allocator const * String_Allocator_use(String_Allocator const * allocator);
+// as String_init but a new buffer comes from 'allocator' (the current one if NULL). strings remember 
+// the allocator of their buffer and grow and free with it
+void String_init_with(String * restrict str, String_Allocator const * allocator, 
+	char const * restrict buf, ptrdiff_t size, size_t capacity);
+
+// a bump allocator for String buffers. allocation is a pointer bump, the most recently allocated
+// buffer grows in place and String_dest only gives back the most recent buffer. String_Arena_reset
+// releases every buffer at once, after which the strings that used them must not be touched
+typedef struct String_Arena String_Arena;
+// block_size 0 selects the default of 64 KiB
+String_Arena * String_Arena_new(size_t block_size);
+void String_Arena_reset(String_Arena * arena);
+void String_Arena_del(String_Arena * arena);
+// the allocator of the arena, for String_init_with and String_Allocator_use
+String_Allocator const * String_Arena_allocator(String_Arena * arena);
+// as String_init_with(str, String_Arena_allocator(arena), ...) or with malloc if arena is NULL
+void String_init_arena(String * restrict str, String_Arena * arena, char const * restrict buf, 
+	ptrdiff_t size, size_t capacity);
+// makes 'arena' the source of every new buffer in this thread, e.g. those of String_init, 
+// String_copy, String_split and String_partition, as String_Allocator_use. NULL ends it. returns the
+// previous arena or NULL if the previous override was not an arena
+String_Arena * String_Arena_use(String_Arena * arena);
 // if succeeds, 'suffix' must be destroyed
 void String_partition(String * str, String const * sep, String * restrict suffix);
 // if succeeds, 'suffix' must be destroyed
 void String_rpartition(String * str, String const * sep, String * restrict suffix);
 // if succeeds, 'dest' must be destroy
 void String_copy(String * restrict dest, String const * restrict src);
+// as String_copy, but a buffer on the heap is shared instead of copied: 'dest' and 'src' then hold 
+// an atomic reference count on it and both must be destroyed. the first in-place change to either 
+// (String_set, String_append, String_replace, String_lower, ...) gives it a private copy, unless it 
+// is the last owner. inline strings and views are copied. the first share of a buffer allocates a 
+// small control block for the count from the allocator of the buffer. returns -1 on allocation 
+// failure
+int String_share(String * restrict dest, String * restrict src);
+// shares [start, end) of 'src' as String_share, with the range arguments of String_find
+int String_share_slice(String * restrict dest, String * restrict src, ptrdiff_t start, 
+	ptrdiff_t end);
 // returns the number of tabs replaced
 int String_expand_tabs(String * str, unsigned char tabsize);
+// append, extend, join, replace, expand_tabs and slice grow buffers geometrically by 
+// STRING_GROWTH_FACTOR, so building a string piece by piece copies each byte O(1) times. a string 
+// that does not own its buffer (capacity 0) gets its own copy the first time it grows or is 
+// written in place (String_set, String_lower, String_translate, String_replace, ...), which it must
+// then destroy
 int String_append(String * str, char chr);
 int String_extend(String * restrict str, String const * restrict other);
+// ensures room for at least 'capacity' chars without growing geometrically. never shrinks. returns -1
+// on allocation failure or if capacity exceeds PTRDIFF_MAX
+int String_reserve(String * str, size_t capacity);
+// gives back unused capacity, moving the string inline if it now fits. returns -1 on failure, in 
+// which case the string is unchanged
+int String_shrink_to_fit(String * str);
+// replaces the first 'count' (all if count <= 0) occurrences of 'old' in place. returns the number 
+// replaced or -1 on allocation failure
 int String_replace(String * str, String const * restrict old, String const * restrict new, 
 	int count);
+// as String_replace but writes the result into 'dest', reusing its buffer if it owns one and 
+// growing it as needed. 'src' is unchanged. 'dest' must be destroyed
+int String_replace_into(String * restrict dest, String const * restrict src, 
+	String const * restrict old, String const * restrict new, int count);
 // returns NULL if a null-terminator could not be added
 char * String_cstr(String * str);
-// separate on whitespace if sep is NULL
+// fills up to nsplit elements of dest and returns the number filled. if sep is NULL, splits on runs 
+// of whitespace and ignores leading and trailing whitespace
 ptrdiff_t String_split(ptrdiff_t nsplit, String * restrict dest, String * restrict str, String * restrict sep);
+// splits lazily and without allocating. pieces are views into the source string with capacity 0 
+// and remain valid as long as the source buffer. if sep is NULL, splits on runs of whitespace. at 
+// most maxsplit splits are made (unlimited if negative), the last piece being the unsplit rest. if
+// reverse, pieces are produced from the end of the string as by Python's str.rsplit. 'sep' is
+// factored once by String_SplitIter_init and must not change until the iteration is done
+typedef struct String_SplitIter {
+	String rest;
+	String const * sep;
+	unsigned char sep_factor_[6 * sizeof(void *)]; // opaque
+	ptrdiff_t maxsplit;
+	_Bool reverse;
+	_Bool done;
+} String_SplitIter;
+void String_SplitIter_init(String_SplitIter * it, String const * str, String const * sep, 
+	ptrdiff_t maxsplit, _Bool reverse);
+// returns false when there are no more pieces
+_Bool String_SplitIter_next(String_SplitIter * it, String * piece);
 int String_join(String * restrict dest, String const * restrict sep, ptrdiff_t n, 
 	String const * const restrict strings);
 // step == 0 is used as step == 1, if step > 0 and end == 0, String_len is used as end
 int String_slice(String * restrict dest, String const * restrict str, ptrdiff_t start, ptrdiff_t end, ptrdiff_t step);
 
-// allocates upon return
+// allocates upon return. the String itself comes from malloc whatever the allocator
 String * String_new(char const * buf, size_t size, size_t capacity);
 
+// selects the instruction set used by the SIMD kernels: "scalar", "sse2", "ssse3" or "avx2". if 
+// NULL, the STRINGS_SIMD environment variable is used if set and otherwise the best level the CPU 
+// supports. falls back to the best supported level and returns -1 if the requested level is unknown
+// or not supported. kernels are otherwise selected on first use. safe to call while other threads
+// use the library, which switch kernels call by call
+int String_simd_select(char const * level);
+char const * String_simd_level(void);
+
+// a needle compiled once for repeated searches. returns NULL if the needle is empty or allocation 
+// fails. the pattern keeps its own copy of the needle
+typedef struct String_Pattern String_Pattern;
+String_Pattern * String_Pattern_new(String const * needle);
+void String_Pattern_del(String_Pattern * pat);
+ptrdiff_t String_Pattern_len(String_Pattern const * pat);
+// String_find, String_count and String_split with a compiled needle
+ptrdiff_t String_find_pat(String const * str, String_Pattern const * pat, ptrdiff_t start, ptrdiff_t end);
+int String_count_pat(String const * str, String_Pattern const * pat, ptrdiff_t start, ptrdiff_t end);
+ptrdiff_t String_split_pat(ptrdiff_t nsplit, String * restrict dest, String * restrict str, 
+	String_Pattern const * sep);
+
+// a set of needles compiled into an Aho-Corasick automaton so that all of them are searched in a 
+// single pass. returns NULL if n < 1, any needle is empty or allocation fails. the needles are not
+// referenced after compilation
+typedef struct String_PatternSet String_PatternSet;
+String_PatternSet * String_PatternSet_new(ptrdiff_t n, String const * needles);
+void String_PatternSet_del(String_PatternSet * set);
+// returns the location of the earliest match of any needle or -1. if several needles match there,
+// the longest is chosen. if 'which' is not NULL, it receives the index of the matching needle
+ptrdiff_t String_find_any(String const * str, String_PatternSet const * set, ptrdiff_t start, 
+	ptrdiff_t end, ptrdiff_t * which);
+// counts non-overlapping matches as found by successive String_find_any, which restart at the end
+// of each match
+int String_count_any(String const * str, String_PatternSet const * set, ptrdiff_t start, ptrdiff_t end);
+// replaces the matches of String_find_any, scanning left to right, with new[i] for needle i, in one
+// pass: in place if no new[i] is longer than needle i, otherwise into a buffer that grows as matches
+// are found. after each match the scan restarts at its end, so bytes read while a longer needle 
+// could still have matched are read again. 'new' must not point into 'str'. returns the number 
+// replaced or -1 on allocation failure
+int String_replace_any(String * str, String_PatternSet const * set, String const * new);
+// as String_replace_any with the n needles in 'old' compiled for a single use. returns -1 if any 
+// needle in 'old' is empty
+int String_replace_many(String * str, ptrdiff_t n, String const * old, String const * new);
+
+// accumulates appends in a chain of chunks that are never moved, so that building a long string 
+// does not copy it while it grows. String_Builder_build copies the result once into a String of 
+// exactly the right size, or String_Builder_views exports the chunks without copying
+typedef struct String_Builder String_Builder;
+// chunk_size 0 selects the default of 4 KiB. larger appends get a chunk of their own size
+String_Builder * String_Builder_new(size_t chunk_size);
+void String_Builder_del(String_Builder * builder);
+// empties the builder, keeping its first chunk for reuse
+void String_Builder_clear(String_Builder * builder);
+ptrdiff_t String_Builder_len(String_Builder const * builder);
+// the appends return -1 on allocation failure, in which case the builder is unchanged
+int String_Builder_append(String_Builder * builder, char chr);
+int String_Builder_extend(String_Builder * builder, String const * str);
+// formats as printf directly into the free space of the last chunk. returns the number of chars 
+// appended or -1 on a formatting or allocation failure
+int String_Builder_appendf(String_Builder * builder, char const * format, ...);
+int String_Builder_vappendf(String_Builder * builder, char const * format, va_list args);
+// initializes 'dest' with a copy of everything appended. any previous buffer of 'dest' is not freed.
+// returns -1 on allocation failure. if succeeds, 'dest' must be destroyed
+int String_Builder_build(String_Builder const * builder, String * dest);
+// fills up to n 'views' (capacity 0) of the chunks in order, as for writev, and returns the number 
+// of non-empty chunks. the views are valid until the builder is next changed
+ptrdiff_t String_Builder_views(String_Builder const * builder, ptrdiff_t n, String * views);
+
+// a string stored as a balanced tree of String leaves for large texts under many edits. insert, 
+// erase, concat, split and indexing take O(log n) time plus the size of what is inserted, instead
+// of moving the whole text. locations are byte offsets in [0, String_Rope_len]
+typedef struct String_Rope String_Rope;
+// a rope with a copy of 'str', which may be NULL for an empty rope
+String_Rope * String_Rope_new(String const * str);
+void String_Rope_del(String_Rope * rope);
+ptrdiff_t String_Rope_len(String_Rope const * rope);
+// as String_get
+char String_Rope_get(String_Rope const * rope, ptrdiff_t loc);
+// the edits return -1 if a location is out of range or on allocation failure, in which case the 
+// rope is unchanged
+int String_Rope_insert(String_Rope * rope, ptrdiff_t loc, String const * str);
+// removes the bytes in [start, end)
+int String_Rope_erase(String_Rope * rope, ptrdiff_t start, ptrdiff_t end);
+// moves the contents of 'other' to the end of 'rope' and deletes 'other'
+int String_Rope_concat(String_Rope * rope, String_Rope * other);
+// cuts 'rope' at 'loc' and returns a new rope with the bytes from 'loc' on, or NULL on failure
+String_Rope * String_Rope_split(String_Rope * rope, ptrdiff_t loc);
+// iterates over the leaves in order as views, starting at byte *pos (0 for the whole rope). the first
+// chunk starts at *pos even inside a leaf. the views are valid until the rope is next changed
+_Bool String_Rope_next(String_Rope const * rope, ptrdiff_t * pos, String * chunk);
+// initializes 'dest' with a copy of [start, end), with the range arguments of String_find. returns
+// -1 on allocation failure. if succeeds, 'dest' must be destroyed
+int String_Rope_copy(String_Rope const * rope, ptrdiff_t start, ptrdiff_t end, String * dest);
+// as String_find and String_count, including matches that span leaves. the search copies the range
+// through a window of twice the larger of the needle and a leaf, which is allocated for needles
+// longer than a leaf. both return -1 on allocation failure
+ptrdiff_t String_Rope_find(String_Rope const * rope, String const * sub, ptrdiff_t start, 
+	ptrdiff_t end);
+int String_Rope_count(String_Rope const * rope, String const * sub, ptrdiff_t start, ptrdiff_t end);
+
 #endif
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "strings.h"
 #include "test_utils.h"
 
@@ -47,10 +48,24 @@ size_t nstrings = 0;
 
 String * dynamic_strings = NULL;
 
+// small deterministic generator for the randomized tests
+static unsigned long test_rand_state = 1;
+static unsigned test_rand(void) {
+	test_rand_state = test_rand_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned)(test_rand_state >> 33);
+}
+
+// fills buf with characters drawn from the first 'nalpha' lowercase letters
+static void test_rand_fill(char * buf, ptrdiff_t size, unsigned nalpha) {
+	for (ptrdiff_t i = 0; i < size; i++) {
+		buf[i] = 'a' + test_rand() % nalpha;
+	}
+}
+
 // tests String_copy, and partially String_init
 int test_setup(void) {
 	String * s = &static_strings[nstrings++];
-	while (s->str) {
+	while (String_data(s)) {
 		s = static_strings + nstrings++;
 	}
 	
@@ -64,20 +79,21 @@ int test_setup(void) {
 	verbose_start(__func__);
 	for (size_t i = 0; i < nstrings; i++) {
 		String_copy(dynamic_strings + i, static_strings + i);
-		nerrors += CHECK(dynamic_strings[i].size == static_strings[i].size, 
+		nerrors += CHECK(String_len(&dynamic_strings[i]) == String_len(&static_strings[i]), 
 			"size mismatch between strings for string %s. expected %ll, found %ll\n",
-			static_strings[i].str, (long long)static_strings[i].size, 
-			(long long)dynamic_strings[i].size);
-		if (static_strings[i].size) {
-			nerrors += CHECK(dynamic_strings[i].capacity >= (size_t)static_strings[i].size,
+			String_data(&static_strings[i]), (long long)String_len(&static_strings[i]), 
+			(long long)String_len(&dynamic_strings[i]));
+		if (String_len(&static_strings[i])) {
+			nerrors += CHECK(String_capacity(&dynamic_strings[i]) >= (size_t)String_len(&static_strings[i]),
 				"failed to allocate sufficient space for string %s. expected >=%ll, found %zu\n",
-				static_strings[i].str, (long long)static_strings[i].size, 
-				dynamic_strings[i].capacity);
-			nerrors += CHECK(dynamic_strings[i].str, 
+				String_data(&static_strings[i]), (long long)String_len(&static_strings[i]), 
+				String_capacity(&dynamic_strings[i]));
+			nerrors += CHECK(String_data(&dynamic_strings[i]), 
 				"failed to create a unique char * for string %s\n", 
-				static_strings[i].str);
-			nerrors += CHECK(!strncmp(dynamic_strings[i].str, static_strings[i].str, dynamic_strings[i].size),
-				"failed to copy string %s to dynamic allocation\n", static_strings[i].str);
+				String_data(&static_strings[i]));
+			nerrors += CHECK(!strncmp(String_data(&dynamic_strings[i]), String_data(&static_strings[i]), 
+				String_len(&dynamic_strings[i])),
+				"failed to copy string %s to dynamic allocation\n", String_data(&static_strings[i]));
 		}
 	}
 	verbose_end(nerrors);
@@ -88,9 +104,9 @@ int test_String_is_empty(void) {
 	verbose_start(__func__);
 	int nerrors = 0;
 	for (size_t i = 0; i < nstrings; i++) {
-		nerrors += CHECK(String_is_empty(&static_strings[i]) == (static_strings[i].size == 0),
+		nerrors += CHECK(String_is_empty(&static_strings[i]) == (String_len(&static_strings[i]) == 0),
 			"failed to identify an empty string %s. expected %s, found %s\n",
-			(static_strings[i].size == 0) ? "true" : "false", 
+			(String_len(&static_strings[i]) == 0) ? "true" : "false", 
 			String_is_empty(&static_strings[i]) ? "true" : "false");
 	}
 	verbose_end(nerrors);
@@ -102,11 +118,11 @@ int test_String_compare(void) {
 	int nerrors = 0;
 	for (size_t i = 0; i < nstrings; i++) {
 		for (size_t j = 0; j < nstrings; j++) {
-			if (static_strings[i].size || dynamic_strings[j].size) {
+			if (String_len(&static_strings[i]) || String_len(&dynamic_strings[j])) {
 				nerrors += CHECK((0 == String_compare(static_strings + i, dynamic_strings + j)) == (i == j),
 					"failure. expected %s and %.*s to compare %s equal\n",
-					static_strings[i].str, (int)dynamic_strings[i].size, 
-					dynamic_strings[i].str,	i == j ? "" : "not");
+					String_data(&static_strings[i]), (int)String_len(&dynamic_strings[i]), 
+					String_data(&dynamic_strings[i]),	i == j ? "" : "not");
 			} else {
 				nerrors += CHECK(!String_compare(static_strings + i, dynamic_strings + j),
 					"failure. expected empty strings to compare equal\n", "");
@@ -117,14 +133,135 @@ int test_String_compare(void) {
 	return nerrors;
 }
 
+// checks String_compare, String_equal, String_common_prefix_len and the prefix and suffix tests 
+// against a byte loop through every SIMD level, with embedded nulls
+int test_String_mismatch(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	String a = {.str = "ab\0c", .size = 4};
+	String b = {.str = "ab\0d", .size = 4};
+	nerrors += CHECK(String_compare(&a, &b) < 0 && !String_equal(&a, &b) && 
+		3 == String_common_prefix_len(&a, &b),
+		"failed to compare past an embedded null%s\n", "");
+
+	char const * levels[] = {"scalar", "sse2", "avx2"};
+	char x[100];
+	char y[100];
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (String_simd_select(levels[l])) {
+			continue;
+		}
+		for (int trial = 0; trial < 2000; trial++) {
+			ptrdiff_t n = test_rand() % sizeof(x);
+			ptrdiff_t m = test_rand() % 4 ? n : (ptrdiff_t)(test_rand() % sizeof(y));
+			for (ptrdiff_t i = 0; i < (n > m ? n : m); i++) {
+				x[i] = (char)(test_rand() % 3 ? 0 : 0xF0);
+				y[i] = x[i];
+			}
+			if (test_rand() % 2) { // plant a single difference
+				ptrdiff_t k = test_rand() % sizeof(y);
+				y[k] = (char)test_rand();
+			}
+			ptrdiff_t min = n < m ? n : m;
+			ptrdiff_t prefix = 0;
+			while (prefix < min && x[prefix] == y[prefix]) {
+				prefix++;
+			}
+			int expected = prefix < min ? 
+				(unsigned char)x[prefix] - (unsigned char)y[prefix] : (n > m) - (n < m);
+			String xs = {.str = x, .size = n};
+			String ys = {.str = y, .size = m};
+			int result = String_compare(&xs, &ys);
+			nerrors += CHECK((result > 0) - (result < 0) == (expected > 0) - (expected < 0),
+				"%s: String_compare mismatch on trial %d. expected %d, found %d\n", 
+				levels[l], trial, expected, result);
+			nerrors += CHECK(String_equal(&xs, &ys) == !expected,
+				"%s: String_equal mismatch on trial %d\n", levels[l], trial);
+			nerrors += CHECK(prefix == String_common_prefix_len(&xs, &ys),
+				"%s: String_common_prefix_len mismatch on trial %d. expected %lld, found %lld\n", 
+				levels[l], trial, (long long)prefix, (long long)String_common_prefix_len(&xs, &ys));
+			nerrors += CHECK(String_starts_with(&xs, &ys) == (m <= n && prefix == m),
+				"%s: String_starts_with mismatch on trial %d\n", levels[l], trial);
+			_Bool suffix = m <= n && !memcmp(x + n - m, y, m);
+			nerrors += CHECK(String_ends_with(&xs, &ys) == suffix,
+				"%s: String_ends_with mismatch on trial %d\n", levels[l], trial);
+		}
+	}
+	String_simd_select(NULL);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_hash(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	// the reference vectors of wyhash, seeded with their index
+	struct {
+		char const * key;
+		uint64_t hash;
+	} vectors[] = {
+		{"", 0x0409638ee2bde459ULL},
+		{"a", 0xa8412d091b5fe0a9ULL},
+		{"abc", 0x32dd92e4b2915153ULL},
+		{"message digest", 0x8619124089a3a16bULL},
+		{"abcdefghijklmnopqrstuvwxyz", 0x7a43afb61d7f5f40ULL},
+		{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 0xff42329b90e50d58ULL},
+		{"12345678901234567890123456789012345678901234567890123456789012345678901234567890", 
+			0xc39cab13b115aad3ULL},
+	};
+	uint16_t const endian = 1;
+	if (*(unsigned char const *)&endian) {
+		for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+			String key = {.str = (char *)vectors[i].key, .size = strlen(vectors[i].key)};
+			uint64_t hash = String_hash(&key, i);
+			nerrors += CHECK(vectors[i].hash == hash,
+				"hash of '%s' is incorrect. expected %016llx, found %016llx\n", vectors[i].key,
+				(unsigned long long)vectors[i].hash, (unsigned long long)hash);
+		}
+	}
+
+	// every single bit flip of a key and every truncation changes its hash
+	char buf[100];
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = (char)test_rand();
+	}
+	String key = {.str = buf, .size = sizeof(buf)};
+	uint64_t hash = String_hash(&key, 0);
+	int collisions = 0;
+	for (size_t i = 0; i < 8 * sizeof(buf); i++) {
+		buf[i / 8] ^= 1 << (i % 8);
+		collisions += hash == String_hash(&key, 0);
+		buf[i / 8] ^= 1 << (i % 8);
+	}
+	for (key.size = 0; key.size < (ptrdiff_t)sizeof(buf); key.size++) {
+		collisions += hash == String_hash(&key, 0);
+	}
+	key.size = sizeof(buf);
+	collisions += hash == String_hash(&key, 1);
+	nerrors += CHECK(!collisions, "found %d hash collisions among single bit flips\n", collisions);
+
+	String_Hashed a, b;
+	String_Hashed_init(&a, &static_strings[10], 7);
+	String_Hashed_init(&b, &dynamic_strings[10], 7);
+	nerrors += CHECK(String_Hashed_equal(&a, &b), "failed to match equal hashed strings%s\n", "");
+	String_Hashed_init(&b, &dynamic_strings[9], 7);
+	nerrors += CHECK(!String_Hashed_equal(&a, &b), "matched different hashed strings%s\n", "");
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
 int test_String_in(void) {
 	verbose_start(__func__);
 	int nerrors = 0;
 	for (size_t i = 0; i < nstrings; i++) {
-		if (static_strings[i].size) {
+		if (String_len(&static_strings[i])) {
 			nerrors += CHECK(String_in(dynamic_strings + i, static_strings + i),
 				"failed to find string \"%s\"in itself\n",
-				static_strings[i].str);
+				String_data(&static_strings[i]));
 		} else {
 			nerrors += CHECK(!String_in(dynamic_strings + i, static_strings + i),
 				"String_in did not fail on empty string (index %zu)\n", i);
@@ -159,7 +296,7 @@ int test_String_char_in(void) {
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < nchars; j++) {
 			nerrors += CHECK(results[i][j] == String_char_in(static_strings + i, chars[j]),
-				"failed to find character %c in %s\n", chars[j], static_strings[i].str);
+				"failed to find character %c in %s\n", chars[j], String_data(&static_strings[i]));
 		}
 	}
 	verbose_end(nerrors);
@@ -175,7 +312,7 @@ int test_String_lower(void) {
 		String_lower(&test);
 		nerrors += CHECK(!String_compare(&test, static_strings + i),
 			"lowering failed. expected %s, found %.*s\n",
-			static_strings[i].str, (int)test.size, test.str);
+			String_data(&static_strings[i]), (int)String_len(&test), String_data(&test));
 		String_dest(&test);
 	}
 	verbose_end(nerrors);
@@ -192,34 +329,148 @@ int test_String_upper(void) {
 		String_upper(&test);
 		nerrors += CHECK(!String_compare(&test, static_upper + i),
 			"lowering failed. expected %s, found %.*s\n",
-			static_upper[i].str, (int)test.size, test.str);
+			String_data(&static_upper[i]), (int)String_len(&test), String_data(&test));
 		String_dest(&test);
 	}
 	verbose_end(nerrors);
 	return nerrors;
 }
 
+// runs String_lower, String_upper and their copying variants through every SIMD level
+int test_String_case(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	char const * levels[] = {"scalar", "sse2", "avx2"};
+	char buf[150];
+	char lower[150];
+	char upper[150];
+	String out = {0};
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (String_simd_select(levels[l])) {
+			continue;
+		}
+		for (int trial = 0; trial < 500; trial++) {
+			ptrdiff_t n = test_rand() % sizeof(buf);
+			for (ptrdiff_t i = 0; i < n; i++) {
+				// mostly letters and their neighbours, sometimes any byte
+				buf[i] = (char)(test_rand() % 4 ? '?' + test_rand() % 64 : test_rand());
+				lower[i] = buf[i] >= 'A' && buf[i] <= 'Z' ? buf[i] + 32 : buf[i];
+				upper[i] = buf[i] >= 'a' && buf[i] <= 'z' ? buf[i] - 32 : buf[i];
+			}
+			String src = {.str = buf, .size = n};
+			String_lower_into(&out, &src);
+			nerrors += CHECK(!String_compare(&out, &(String){.str = lower, .size = n}),
+				"%s: String_lower_into mismatch on trial %d\n", levels[l], trial);
+			String_upper_into(&out, &src);
+			nerrors += CHECK(!String_compare(&out, &(String){.str = upper, .size = n}),
+				"%s: String_upper_into mismatch on trial %d\n", levels[l], trial);
+			String_lower(&src);
+			nerrors += CHECK(!String_compare(&src, &(String){.str = lower, .size = n}),
+				"%s: String_lower mismatch on trial %d\n", levels[l], trial);
+			String_upper(&src);
+			nerrors += CHECK(!String_compare(&src, &(String){.str = upper, .size = n}),
+				"%s: String_upper mismatch on trial %d\n", levels[l], trial);
+			String_dest(&src);
+		}
+	}
+	String_simd_select(NULL);
+
+	String_dest(&out);
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_translate(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	unsigned char table[256];
+	String_maketrans(table, &(String){.str = "lo", .size = 2}, &(String){.str = "01", .size = 2});
+	String_CharSet drop;
+	String_CharSet_init(&drop, &(String){.str = " ", .size = 1});
+	String test = {0};
+	String_init(&test, "hello world", 11, 0);
+	String_translate(&test, table, &drop);
+	nerrors += CHECK(!String_compare(&test, &(String){.str = "he001w1r0d", .size = 10}),
+		"failed to translate 'hello world'. expected 'he001w1r0d', found '%.*s'\n", 
+		(int)String_len(&test), String_data(&test));
+
+	char const * levels[] = {"scalar", "ssse3", "avx2"};
+	char buf[200];
+	char expected[200];
+	String out = {0};
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (String_simd_select(levels[l])) {
+			continue;
+		}
+		for (int trial = 0; trial < 1000; trial++) {
+			// remap a few random rows of the table and drop a few random bytes
+			for (int c = 0; c < 256; c++) {
+				table[c] = (unsigned char)c;
+			}
+			for (int r = test_rand() % 4; r > 0; r--) {
+				unsigned h = test_rand() % 16;
+				for (int c = 0; c < 16; c++) {
+					table[16 * h + c] = (unsigned char)test_rand();
+				}
+			}
+			char chars[4] = {0};
+			ptrdiff_t nchars = test_rand() % 5;
+			for (ptrdiff_t i = 0; i < nchars; i++) {
+				chars[i] = (char)test_rand();
+			}
+			String_CharSet_init(&drop, &(String){.str = chars, .size = nchars});
+			String_CharSet const * dropped = nchars ? &drop : NULL;
+			ptrdiff_t n = test_rand() % sizeof(buf);
+			for (ptrdiff_t i = 0; i < n; i++) {
+				buf[i] = test_rand() % 2 ? (char)test_rand() : chars[test_rand() % 4];
+			}
+			ptrdiff_t size = 0;
+			for (ptrdiff_t i = 0; i < n; i++) {
+				if (!dropped || !memchr(chars, buf[i], nchars)) {
+					expected[size++] = (char)table[(unsigned char)buf[i]];
+				}
+			}
+			String src = {.str = buf, .size = n};
+			String_translate_into(&out, &src, table, dropped);
+			nerrors += CHECK(!String_compare(&out, &(String){.str = expected, .size = size}),
+				"%s: String_translate_into mismatch on trial %d\n", levels[l], trial);
+			String_translate(&src, table, dropped);
+			nerrors += CHECK(!String_compare(&src, &(String){.str = expected, .size = size}),
+				"%s: String_translate mismatch on trial %d\n", levels[l], trial);
+			String_dest(&src);
+		}
+	}
+	String_simd_select(NULL);
+
+	String_dest(&out);
+	String_dest(&test);
+	verbose_end(nerrors);
+	return nerrors;
+}
+
 int test_String_get(void) {
 	verbose_start(__func__);
 	int nerrors = 0;
 	for (size_t i = 0; i < nstrings; i++) {
-		char * str_ = dynamic_strings[i].str;
-		ptrdiff_t size = dynamic_strings[i].size;
+		char * str_ = String_data(&dynamic_strings[i]);
+		ptrdiff_t size = String_len(&dynamic_strings[i]);
 		for (ptrdiff_t j = 0; j < size; j++) {
 			nerrors += CHECK(str_[j] == String_get(dynamic_strings + i, j),
 				"failed to retrieve correct character at index %lld for %.*s. expected %c, found %c\n",
-				(long long)j, (int)size, dynamic_strings[i].str,
+				(long long)j, (int)size, String_data(&dynamic_strings[i]),
 				str_[j], String_get(dynamic_strings + i, j));
 		}
 		for (ptrdiff_t j = -1; j > -size; j--) {
 			nerrors += CHECK(str_[j + size] == String_get(dynamic_strings + i, j),
 				"failed to retrieve correct character at index %lld for %.*s. expected %c, found %c\n",
-				(long long)j, (int)size, dynamic_strings[i].str,
+				(long long)j, (int)size, String_data(&dynamic_strings[i]),
 				str_[j + size], String_get(dynamic_strings + i, j));
 		}
 		nerrors += CHECK('\0' == String_get(dynamic_strings + i, size),
 			"failed to retrieve correct character at index %lld for %.*s. expected (null), found %c\n",
-			(long long)size, (int)size, dynamic_strings[i].str,
+			(long long)size, (int)size, String_data(&dynamic_strings[i]),
 			String_get(dynamic_strings + i, size));
 	}
 	verbose_end(nerrors);
@@ -232,17 +483,17 @@ int test_String_set(void) {
 	String test = {0};
 	char testc = '/';
 	for (size_t i = 0; i < nstrings; i++) {
-		ptrdiff_t size = dynamic_strings[i].size;
+		ptrdiff_t size = String_len(&dynamic_strings[i]);
 		for (ptrdiff_t j = 0; j < size; j++) {
 			String_copy(&test, dynamic_strings + i);
 			char old = String_set(&test, j, testc);
 			nerrors += CHECK(String_get(static_strings + i, j) == old,
 				"failed to retrieve original character at index %lld for %.*s. expected %c, found %c\n",
-				(long long)j, (int)size, dynamic_strings[i].str,
+				(long long)j, (int)size, String_data(&dynamic_strings[i]),
 				String_get(static_strings + i, j), old);
 			nerrors += CHECK(testc == String_get(&test, j),
 				"failed to set character at index %lld to %c in %s, found %c\n",
-				(long long)j, testc, static_strings[i].str, String_get(&test, j));
+				(long long)j, testc, String_data(&static_strings[i]), String_get(&test, j));
 			String_dest(&test);
 		}
 		for (ptrdiff_t j = -1; j > -size; j--) {
@@ -250,17 +501,17 @@ int test_String_set(void) {
 			char old = String_set(&test, j, testc);
 			nerrors += CHECK(String_get(static_strings + i, j) == old,
 				"failed to retrieve original character at index %lld for %.*s. expected %c, found %c\n",
-				(long long)j, (int)size, dynamic_strings[i].str,
+				(long long)j, (int)size, String_data(&dynamic_strings[i]),
 				String_get(static_strings + i, j), old);
 			nerrors += CHECK(testc == String_get(&test, j),
 				"failed to set character at index %lld to %c in %s, found %c\n",
-				(long long)j, testc, static_strings[i].str, String_get(&test, j));
+				(long long)j, testc, String_data(&static_strings[i]), String_get(&test, j));
 			String_dest(&test);
 		}
 		String_copy(&test, dynamic_strings + i);
 		nerrors += CHECK('\0' == String_set(&test, size, testc),
 			"failed to retrieve correct character at index %lld for %.*s. expected (null), found %c\n",
-			(long long)size, (int)size, dynamic_strings[i].str,
+			(long long)size, (int)size, String_data(&dynamic_strings[i]),
 			String_get(dynamic_strings + i, size));
 		String_dest(&test);
 	}
@@ -299,8 +550,8 @@ int test_String_starts_with(void) {
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
 			nerrors += CHECK(results[i][j] == String_starts_with(static_strings + i, &tests[j]),
-				"failed identify that %s %s start with %s\n", static_strings[i].str, 
-				results[i][j] ? "does" : "doesn't", tests[j].str);
+				"failed identify that %s %s start with %s\n", String_data(&static_strings[i]), 
+				results[i][j] ? "does" : "doesn't", String_data(&tests[j]));
 		}
 	}
 	verbose_end(nerrors);
@@ -338,8 +589,8 @@ int test_String_ends_with(void) {
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
 			nerrors += CHECK(results[i][j] == String_ends_with(static_strings + i, &tests[j]),
-				"failed identify that %s %s end with %s\n", static_strings[i].str, 
-				results[i][j] ? "does" : "doesn't", tests[j].str);
+				"failed identify that %s %s end with %s\n", String_data(&static_strings[i]), 
+				results[i][j] ? "does" : "doesn't", String_data(&tests[j]));
 		}
 	}
 	
@@ -379,11 +630,11 @@ int test_String_find(void) {
 	int end = 0;
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = (int)static_strings[i].size;
+			end = (int)String_len(&static_strings[i]);
 			nerrors += CHECK(results[i][j] == String_find(static_strings + i, &tests[j], start, end),
 				"failed to find %.*s at loc %d in '%.*s'\n", 
-				(int)tests[j].size, tests[j].str, results[i][j], 
-				end - start, static_strings[i].str + start);
+				(int)String_len(&tests[j]), String_data(&tests[j]), results[i][j], 
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 
@@ -405,12 +656,12 @@ int test_String_find(void) {
 
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = (int)static_strings[i].size;
+			end = (int)String_len(&static_strings[i]);
 			start = end / 2;
 			nerrors += CHECK(results_half[i][j] == String_find(static_strings + i, &tests[j], start, end),
 				"failed to find %.*s at loc %d in '%.*s'\n", 
-				(int)tests[j].size, tests[j].str, results_half[i][j], 
-				end - start, static_strings[i].str + start);
+				(int)String_len(&tests[j]), String_data(&tests[j]), results_half[i][j], 
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 
@@ -433,14 +684,14 @@ int test_String_find(void) {
 	start = 0;
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = ((int)static_strings[i].size) / 2;
-			if (!end && static_strings[i].size) {
+			end = ((int)String_len(&static_strings[i])) / 2;
+			if (!end && String_len(&static_strings[i])) {
 				end++;
 			}
 			nerrors += CHECK(results_end[i][j] == String_find(static_strings + i, &tests[j], start, end),
 				"failed to find %.*s at loc %d in '%.*s'\n", 
-				(int)tests[j].size, tests[j].str, results_end[i][j], 
-				end - start, static_strings[i].str + start);
+				(int)String_len(&tests[j]), String_data(&tests[j]), results_end[i][j], 
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 	
@@ -480,11 +731,11 @@ int test_String_rfind(void) {
 	int end = 0;
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = (int)static_strings[i].size;
+			end = (int)String_len(&static_strings[i]);
 			nerrors += CHECK(results[i][j] == String_rfind(static_strings + i, &tests[j], start, end),
 				"failed to find %.*s at loc %d in '%.*s'\n", 
-				(int)tests[j].size, tests[j].str, results[i][j], 
-				end - start, static_strings[i].str + start);
+				(int)String_len(&tests[j]), String_data(&tests[j]), results[i][j], 
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 
@@ -506,12 +757,12 @@ int test_String_rfind(void) {
 
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = (int)static_strings[i].size;
+			end = (int)String_len(&static_strings[i]);
 			start = end / 2;
 			nerrors += CHECK(results_half[i][j] == String_rfind(static_strings + i, &tests[j], start, end),
 				"failed to find %.*s at loc %d in '%.*s'\n", 
-				(int)tests[j].size, tests[j].str, results_half[i][j], 
-				end - start, static_strings[i].str + start);
+				(int)String_len(&tests[j]), String_data(&tests[j]), results_half[i][j], 
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 
@@ -534,14 +785,14 @@ int test_String_rfind(void) {
 	start = 0;
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = ((int)static_strings[i].size) / 2;
-			if (!end && static_strings[i].size) {
+			end = ((int)String_len(&static_strings[i])) / 2;
+			if (!end && String_len(&static_strings[i])) {
 				end++;
 			}
 			nerrors += CHECK(results_end[i][j] == String_rfind(static_strings + i, &tests[j], start, end),
 				"failed to find %.*s at loc %d in '%.*s'\n", 
-				(int)tests[j].size, tests[j].str, results_end[i][j], 
-				end - start, static_strings[i].str + start);
+				(int)String_len(&tests[j]), String_data(&tests[j]), results_end[i][j], 
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 	
@@ -581,11 +832,11 @@ int test_String_count(void) {
 	int end = 0;
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = (int)static_strings[i].size;
+			end = (int)String_len(&static_strings[i]);
 			nerrors += CHECK(results[i][j] == String_count(static_strings + i, &tests[j], start, end),
 				"failed to find %d copies of %.*s in '%.*s'\n", 
-				results[i][j], (int)tests[j].size, tests[j].str,
-				end - start, static_strings[i].str + start);
+				results[i][j], (int)String_len(&tests[j]), String_data(&tests[j]),
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 
@@ -607,12 +858,12 @@ int test_String_count(void) {
 
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = (int)static_strings[i].size;
+			end = (int)String_len(&static_strings[i]);
 			start = end / 2;
 			nerrors += CHECK(results_half[i][j] == String_count(static_strings + i, &tests[j], start, end),
 				"failed to find %d copies of %.*s in '%.*s'\n", 
-				results_half[i][j], (int)tests[j].size, tests[j].str,
-				end - start, static_strings[i].str + start);
+				results_half[i][j], (int)String_len(&tests[j]), String_data(&tests[j]),
+				end - start, String_data(&static_strings[i]) + start);
 		}
 	}
 
@@ -635,21 +886,1291 @@ int test_String_count(void) {
 	start = 0;
 	for (int i = 0; i < nresults; i++) {
 		for (int j = 0; j < ntests; j++) {
-			end = ((int)static_strings[i].size) / 2;
-			if (!end && static_strings[i].size) {
+			end = ((int)String_len(&static_strings[i])) / 2;
+			if (!end && String_len(&static_strings[i])) {
 				end++;
 			}
 			nerrors += CHECK(results_end[i][j] == String_count(static_strings + i, &tests[j], start, end),
 				"failed to find %d copies of %.*s in '%.*s'\n", 
-				results_end[i][j], (int)tests[j].size, tests[j].str,
-				end - start, static_strings[i].str + start);
+				results_end[i][j], (int)String_len(&tests[j]), String_data(&tests[j]),
+				end - start, String_data(&static_strings[i]) + start);
+		}
+	}
+	
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// reference implementation for the search tests
+static ptrdiff_t naive_find(char const * hay, ptrdiff_t n, char const * needle, ptrdiff_t m) {
+	for (ptrdiff_t i = 0; i + m <= n; i++) {
+		if (!memcmp(hay + i, needle, m)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static ptrdiff_t naive_rfind(char const * hay, ptrdiff_t n, char const * needle, ptrdiff_t m) {
+	for (ptrdiff_t i = n - m; i >= 0; i--) {
+		if (!memcmp(hay + i, needle, m)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// exhaustively checks String_find and String_rfind against all haystacks of up to 12 characters and needles of up
+// to 6 characters over the alphabet {a, b}, which covers the periodic needles that trip up
+// naive searches
+int test_String_search_exhaustive(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	char hay[12];
+	char needle[6];
+	for (int n = 1; n <= (int)sizeof(hay); n++) {
+		for (long h = 0; h < (1L << n); h++) {
+			for (int i = 0; i < n; i++) {
+				hay[i] = (h >> i) & 1 ? 'b' : 'a';
+			}
+			String str = {.str = hay, .size = n};
+			for (int m = 1; m <= (int)sizeof(needle) && m <= n; m++) {
+				for (long s = 0; s < (1L << m); s++) {
+					for (int i = 0; i < m; i++) {
+						needle[i] = (s >> i) & 1 ? 'b' : 'a';
+					}
+					String sub = {.str = needle, .size = m};
+					ptrdiff_t expected = naive_find(hay, n, needle, m);
+					ptrdiff_t found = String_find(&str, &sub, 0, n);
+					nerrors += CHECK(expected == found,
+						"failed to find %.*s in '%.*s'. expected %lld, found %lld\n",
+						m, needle, n, hay, (long long)expected, (long long)found);
+					expected = naive_rfind(hay, n, needle, m);
+					found = String_rfind(&str, &sub, 0, n);
+					nerrors += CHECK(expected == found,
+						"failed to rfind %.*s in '%.*s'. expected %lld, found %lld\n",
+						m, needle, n, hay, (long long)expected, (long long)found);
+				}
+			}
+		}
+	}
+
+	// adversarial input for the naive algorithm
+	char long_hay[4096];
+	memset(long_hay, 'a', sizeof(long_hay));
+	long_hay[sizeof(long_hay) - 1] = 'b';
+	char long_needle[256];
+	memset(long_needle, 'a', sizeof(long_needle));
+	long_needle[sizeof(long_needle) - 1] = 'b';
+	String str = {.str = long_hay, .size = sizeof(long_hay)};
+	String sub = {.str = long_needle, .size = sizeof(long_needle)};
+	nerrors += CHECK(sizeof(long_hay) - sizeof(long_needle) == String_find(&str, &sub, 0, 0),
+		"failed to find a%.*sb at the end of a%.*sb\n", 3, "...", 3, "...");
+	nerrors += CHECK(1 == String_count(&str, &sub, 0, 0),
+		"failed to count a%.*sb at the end of a%.*sb\n", 3, "...", 3, "...");
+	long_hay[sizeof(long_hay) - 1] = 'a';
+	long_hay[0] = 'b';
+	long_needle[sizeof(long_needle) - 1] = 'a';
+	long_needle[0] = 'b';
+	nerrors += CHECK(0 == String_rfind(&str, &sub, 0, 0),
+		"failed to rfind b%.*sa at the start of b%.*sa\n", 3, "...", 3, "...");
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+enum {FIRST_USE_THREADS = 4};
+
+// the first calls into the library resolve the SIMD kernels
+static void * test_first_use_worker(void * arg) {
+	int * failures = arg;
+	char buf[64] = "  Hello, World! hello, world!  ";
+	String str = {.str = buf, .size = (ptrdiff_t)strlen(buf)};
+	String sub = {.str = "world", .size = 5};
+	*failures += 23 != String_find(&str, &sub, 0, 0);
+	String_strip(&str, NULL);
+	*failures += 27 != String_len(&str);
+	String_lower(&str);
+	*failures += !!String_compare(&str, &(String){.str = "hello, world! hello, world!", .size = 27});
+	String_CharSet set;
+	String_CharSet_init(&set, &(String){.str = "helo", .size = 4});
+	*failures += 5 != String_span(&str, &set);
+	String_dest(&str);
+	return NULL;
+}
+
+// must run before any other test
+int test_String_simd_first_use(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	pthread_t threads[FIRST_USE_THREADS];
+	int failures[FIRST_USE_THREADS] = {0};
+	for (int t = 0; t < FIRST_USE_THREADS; t++) {
+		nerrors += CHECK(!pthread_create(&threads[t], NULL, test_first_use_worker, &failures[t]),
+			"failed to start thread %d\n", t);
+	}
+	for (int t = 0; t < FIRST_USE_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		nerrors += CHECK(!failures[t], "thread %d failed %d times\n", t, failures[t]);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// runs String_find and String_count through every SIMD level supported by the CPU
+int test_String_simd_find(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	char const * levels[] = {"scalar", "sse2", "ssse3", "avx2"};
+	char hay[1024];
+	char needle[40];
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (String_simd_select(levels[l])) {
+			continue;
+		}
+		for (int trial = 0; trial < 2000; trial++) {
+			ptrdiff_t n = 1 + test_rand() % sizeof(hay);
+			ptrdiff_t m = 1 + test_rand() % sizeof(needle);
+			unsigned nalpha = 1 + test_rand() % 4;
+			test_rand_fill(hay, n, nalpha);
+			if (m <= n && test_rand() % 2) { // plant the needle
+				ptrdiff_t loc = test_rand() % (n - m + 1);
+				memcpy(needle, hay + loc, m);
+			} else {
+				test_rand_fill(needle, m, nalpha);
+			}
+			String str = {.str = hay, .size = n};
+			String sub = {.str = needle, .size = m};
+			ptrdiff_t expected = naive_find(hay, n, needle, m);
+			ptrdiff_t found = String_find(&str, &sub, 0, 0);
+			nerrors += CHECK(expected == found,
+				"%s: failed to find %.*s in a %lld byte haystack. expected %lld, found %lld\n",
+				levels[l], (int)m, needle, (long long)n, (long long)expected, (long long)found);
+			int count = 0;
+			for (ptrdiff_t loc = expected; loc >= 0; ) {
+				count++;
+				ptrdiff_t next = naive_find(hay + loc + m, n - loc - m, needle, m);
+				loc = next < 0 ? -1 : loc + m + next;
+			}
+			nerrors += CHECK(count == String_count(&str, &sub, 0, 0),
+				"%s: failed to count %.*s in a %lld byte haystack. expected %d, found %d\n",
+				levels[l], (int)m, needle, (long long)n, count, String_count(&str, &sub, 0, 0));
 		}
 	}
+	String_simd_select(NULL);
+
+	nerrors += CHECK(-1 == String_simd_select("mmx"), 
+		"failed to reject unknown SIMD level %s\n", "mmx");
 	
 	verbose_end(nerrors);
 	return nerrors;
 }
 
+int test_String_Pattern(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	nerrors += CHECK(!String_Pattern_new(&static_strings[0]),
+		"failed to reject an empty pattern%s\n", "");
+
+	char const * levels[] = {"scalar", NULL};
+	char hay[512];
+	char needle[24];
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		String_simd_select(levels[l]);
+		for (int trial = 0; trial < 1000; trial++) {
+			ptrdiff_t n = 1 + test_rand() % sizeof(hay);
+			ptrdiff_t m = 1 + test_rand() % sizeof(needle);
+			unsigned nalpha = 1 + test_rand() % 4;
+			test_rand_fill(hay, n, nalpha);
+			test_rand_fill(needle, m, nalpha);
+			String str = {.str = hay, .size = n};
+			String sub = {.str = needle, .size = m};
+			String_Pattern * pat = String_Pattern_new(&sub);
+			if (!pat) {
+				nerrors += CHECK(pat, "failed to compile pattern %.*s\n", (int)m, needle);
+				continue;
+			}
+			ptrdiff_t start = test_rand() % n;
+			ptrdiff_t expected = String_find(&str, &sub, start, 0);
+			int expected_count = String_count(&str, &sub, 0, 0);
+			// the pattern must not depend on the source buffer
+			memset(needle, 0, sizeof(needle));
+			nerrors += CHECK(String_Pattern_len(pat) == m,
+				"pattern length mismatch. expected %lld, found %lld\n", 
+				(long long)m, (long long)String_Pattern_len(pat));
+			nerrors += CHECK(expected == String_find_pat(&str, pat, start, 0),
+				"String_find_pat mismatch in '%.*s'. expected %lld, found %lld\n",
+				(int)n, hay, (long long)expected, (long long)String_find_pat(&str, pat, start, 0));
+			nerrors += CHECK(expected_count == String_count_pat(&str, pat, 0, 0),
+				"String_count_pat mismatch in '%.*s'. expected %d, found %d\n",
+				(int)n, hay, expected_count, String_count_pat(&str, pat, 0, 0));
+			String_Pattern_del(pat);
+		}
+	}
+	String_simd_select(NULL);
+
+	char const * path_raw = "path/to/file";
+	String results[] = {
+		{.str = "path", .size = 4},
+		{.str = "to", .size = 2},
+		{.str = "file", .size = 4}
+	};
+	String input = {.str = (char *)path_raw, .size = strlen(path_raw)};
+	String_Pattern * sep = String_Pattern_new(&(String){.str = "/", .size = 1});
+	String test[3] = {0};
+	ptrdiff_t count = String_split_pat(3, &test[0], &input, sep);
+	nerrors += CHECK(3 == count,
+		"failed to split %s by %s to the correct number. expected %d, found %d\n",
+		path_raw, "/", 3, (int)count);
+	for (ptrdiff_t i = 0; i < count; i++) {
+		nerrors += CHECK(!String_compare(&results[i], &test[i]),
+			"%d-th split is incorrect. expected %.*s, found %.*s\n",
+			(int)i, (int)String_len(&results[i]), String_data(&results[i]), (int)String_len(&test[i]), 
+			String_data(&test[i]));
+		String_dest(&test[i]);
+	}
+	String_Pattern_del(sep);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// reference for String_find_any: earliest location, then longest needle, then lowest index
+static ptrdiff_t naive_find_any(char const * hay, ptrdiff_t n, ptrdiff_t nneedles, 
+	String const * needles, ptrdiff_t * which) {
+
+	for (ptrdiff_t i = 0; i < n; i++) {
+		*which = -1;
+		for (ptrdiff_t k = 0; k < nneedles; k++) {
+			ptrdiff_t m = String_len(&needles[k]);
+			if (i + m <= n && !memcmp(hay + i, String_data(&needles[k]), m) && 
+				(*which < 0 || m > String_len(&needles[*which]))) {
+				*which = k;
+			}
+		}
+		if (*which >= 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int test_String_find_any(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	String keywords[] = {
+		{.str = "model", .size = 5},
+		{.str = "mod", .size = 3},
+		{.str = "major", .size = 5},
+		{.str = "general", .size = 7},
+		{.str = "very", .size = 4},
+	};
+	ptrdiff_t nkeywords = sizeof(keywords) / sizeof(keywords[0]);
+	String_PatternSet * set = String_PatternSet_new(nkeywords, keywords);
+	String const * src = &static_strings[10];
+	ptrdiff_t which = -1;
+	ptrdiff_t loc = String_find_any(src, set, 0, 0, &which);
+	nerrors += CHECK(9 == loc && 4 == which,
+		"failed to find 'very' in '%s'. found %lld (needle %lld)\n", 
+		String_data(src), (long long)loc, (long long)which);
+	loc = String_find_any(src, set, 10, 0, &which);
+	nerrors += CHECK(14 == loc && 0 == which,
+		"failed to find 'model' in '%s'. found %lld (needle %lld)\n", 
+		String_data(src), (long long)loc, (long long)which);
+	nerrors += CHECK(5 == String_count_any(src, set, 0, 0),
+		"failed to count keywords in '%s'. expected %d, found %d\n", 
+		String_data(src), 5, String_count_any(src, set, 0, 0));
+	String_PatternSet_del(set);
+
+	nerrors += CHECK(!String_PatternSet_new(1, &static_strings[0]),
+		"failed to reject an empty needle%s\n", "");
+
+	char hay[256];
+	char buf[8][6];
+	String needles[8];
+	for (int trial = 0; trial < 2000; trial++) {
+		ptrdiff_t n = 1 + test_rand() % sizeof(hay);
+		ptrdiff_t nneedles = 1 + test_rand() % 8;
+		unsigned nalpha = 1 + test_rand() % 4;
+		test_rand_fill(hay, n, nalpha);
+		for (ptrdiff_t k = 0; k < nneedles; k++) {
+			needles[k] = (String){.str = buf[k], .size = 1 + test_rand() % sizeof(buf[k])};
+			test_rand_fill(buf[k], String_len(&needles[k]), nalpha);
+		}
+		set = String_PatternSet_new(nneedles, needles);
+		if (!set) {
+			nerrors += CHECK(set, "failed to compile %lld needles\n", (long long)nneedles);
+			continue;
+		}
+		String str = {.str = hay, .size = n};
+		ptrdiff_t expected_which = -1;
+		ptrdiff_t expected = naive_find_any(hay, n, nneedles, needles, &expected_which);
+		loc = String_find_any(&str, set, 0, 0, &which);
+		nerrors += CHECK(expected == loc && (loc < 0 || expected_which == which),
+			"String_find_any mismatch in '%.*s'. expected %lld (needle %lld), found %lld (needle %lld)\n",
+			(int)n, hay, (long long)expected, (long long)expected_which, 
+			(long long)loc, (long long)which);
+		int count = 0;
+		for (ptrdiff_t pos = 0; expected >= 0; ) {
+			count++;
+			pos += expected + String_len(&needles[expected_which]);
+			expected = naive_find_any(hay + pos, n - pos, nneedles, needles, &expected_which);
+		}
+		nerrors += CHECK(count == String_count_any(&str, set, 0, 0),
+			"String_count_any mismatch in '%.*s'. expected %d, found %d\n",
+			(int)n, hay, count, String_count_any(&str, set, 0, 0));
+		String_PatternSet_del(set);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_replace_many(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	String escapes[][2] = {
+		{{.str = "&", .size = 1}, {.str = "&amp;", .size = 5}},
+		{{.str = "<", .size = 1}, {.str = "&lt;", .size = 4}},
+		{{.str = ">", .size = 1}, {.str = "&gt;", .size = 4}},
+		{{.str = "\"", .size = 1}, {.str = "&quot;", .size = 6}},
+		{{.str = "<br>", .size = 4}, {.str = "\n", .size = 1}},
+	};
+	String old[5];
+	String new[5];
+	for (int i = 0; i < 5; i++) {
+		old[i] = escapes[i][0];
+		new[i] = escapes[i][1];
+	}
+	char const * raw = "<a href=\"x\">&</a><br>";
+	char const * escaped = "&lt;a href=&quot;x&quot;&gt;&amp;&lt;/a&gt;\n";
+	String test = {0};
+	String_init(&test, raw, strlen(raw), 0);
+	int nrep = String_replace_many(&test, 5, old, new);
+	nerrors += CHECK(8 == nrep && 
+		!String_compare(&test, &(String){.str = (char *)escaped, .size = strlen(escaped)}),
+		"failed to escape '%s'. expected %d replacements and '%s', found %d and '%.*s'\n",
+		raw, 8, escaped, nrep, (int)String_len(&test), String_data(&test));
+	String_dest(&test);
+
+	// replacements are not rescanned
+	String swap_old[] = {{.str = "ab", .size = 2}, {.str = "ba", .size = 2}};
+	String swap_new[] = {{.str = "ba", .size = 2}, {.str = "ab", .size = 2}};
+	String_init(&test, "abba", 4, 0);
+	String_replace_many(&test, 2, swap_old, swap_new);
+	nerrors += CHECK(!String_compare(&test, &(String){.str = "baab", .size = 4}),
+		"failed to swap 'ab' and 'ba'. expected 'baab', found '%.*s'\n", (int)String_len(&test), String_data(&test));
+	String_dest(&test);
+
+	// shrinking in place copies a view first and leaves its source alone
+	char source[] = "a<br>b<br>c";
+	test = (String){.str = source, .size = strlen(source)};
+	nrep = String_replace_many(&test, 1, &old[4], &new[4]);
+	nerrors += CHECK(2 == nrep && !strcmp(source, "a<br>b<br>c") &&
+		!String_compare(&test, &(String){.str = "a\nb\nc", .size = 5}),
+		"failed to replace in a view. expected 'a\\nb\\nc' and 'a<br>b<br>c' untouched, found '%.*s' and '%s'\n",
+		(int)String_len(&test), String_data(&test), source);
+	String_dest(&test);
+
+	nerrors += CHECK(-1 == String_replace_many(&static_strings[10], 1, &static_strings[0], new),
+		"failed to reject an empty needle%s\n", "");
+
+	char hay[300];
+	char buf[4][4];
+	char expected[300 * 8];
+	for (int trial = 0; trial < 500; trial++) {
+		ptrdiff_t n = 1 + test_rand() % sizeof(hay);
+		ptrdiff_t nneedles = 1 + test_rand() % 4;
+		unsigned nalpha = 1 + test_rand() % 3;
+		test_rand_fill(hay, n, nalpha);
+		for (ptrdiff_t k = 0; k < nneedles; k++) {
+			old[k] = (String){.str = buf[k], .size = 1 + test_rand() % sizeof(buf[k])};
+			test_rand_fill(buf[k], String_len(&old[k]), nalpha);
+			new[k] = (String){.str = "0123456", .size = test_rand() % 8};
+		}
+		ptrdiff_t size = 0;
+		int count = 0;
+		ptrdiff_t which = -1;
+		for (ptrdiff_t pos = 0; pos < n; ) {
+			ptrdiff_t loc = naive_find_any(hay + pos, n - pos, nneedles, old, &which);
+			if (loc < 0) {
+				loc = n - pos;
+			}
+			memcpy(expected + size, hay + pos, loc);
+			size += loc;
+			pos += loc;
+			if (pos < n) {
+				memcpy(expected + size, String_data(&new[which]), String_len(&new[which]));
+				size += String_len(&new[which]);
+				pos += String_len(&old[which]);
+				count++;
+			}
+		}
+		String_init(&test, hay, n, 0);
+		nrep = String_replace_many(&test, nneedles, old, new);
+		nerrors += CHECK(count == nrep && 
+			!String_compare(&test, &(String){.str = expected, .size = size}),
+			"String_replace_many mismatch in '%.*s'. expected %d and '%.*s', found %d and '%.*s'\n",
+			(int)n, hay, count, (int)size, expected, nrep, (int)String_len(&test), String_data(&test));
+		String_dest(&test);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// random puts and removes checked against a presence table. the keys share long prefixes and many
+// land in the same groups
+int test_String_Map(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	enum {NKEYS = 3000};
+	static char bufs[NKEYS][24];
+	static String keys[NKEYS];
+	static _Bool present[NKEYS];
+	for (int i = 0; i < NKEYS; i++) {
+		keys[i] = (String){.str = bufs[i], .size = sprintf(bufs[i], "header-field-%d", i)};
+		present[i] = false;
+	}
+	String_Map * map = String_Map_new(sizeof(int), 0);
+	ptrdiff_t size = 0;
+	for (int step = 0; step < 100000; step++) {
+		int k = test_rand() % NKEYS;
+		unsigned op = test_rand() % 8;
+		if (op < 5) {
+			_Bool inserted = false;
+			int * value = String_Map_put(map, &keys[k], &inserted);
+			nerrors += CHECK(value && inserted == !present[k] && (inserted ? !*value : *value == k),
+				"put of %s returned the wrong entry\n", bufs[k]);
+			if (value) {
+				*value = k;
+			}
+			size += !present[k];
+			present[k] = true;
+		} else if (op < 7) {
+			int value = -1;
+			_Bool removed = String_Map_remove(map, &keys[k], &value);
+			nerrors += CHECK(removed == present[k] && (!removed || value == k),
+				"remove of %s was incorrect\n", bufs[k]);
+			size -= present[k];
+			present[k] = false;
+		} else {
+			int * value = String_Map_get(map, &keys[k]);
+			nerrors += CHECK(present[k] ? value && *value == k : !value,
+				"get of %s was incorrect\n", bufs[k]);
+		}
+		if (step % 25000 == 0) {
+			String_Map_rehash(map, 0); // shrink to fit
+		}
+	}
+	nerrors += CHECK(size == String_Map_len(map), "map has %lld entries. expected %lld\n", 
+		(long long)String_Map_len(map), (long long)size);
+	for (int k = 0; k < NKEYS; k++) {
+		int * value = String_Map_get(map, &keys[k]);
+		nerrors += CHECK(present[k] ? value && *value == k : !value,
+			"final get of %s was incorrect\n", bufs[k]);
+	}
+	ptrdiff_t iter = 0;
+	ptrdiff_t count = 0;
+	String key;
+	void * value;
+	while (String_Map_next(map, &iter, &key, &value)) {
+		int k = *(int *)value;
+		nerrors += CHECK(present[k] && String_data(&key) == bufs[k], "iterated over a wrong entry%s\n", "");
+		count++;
+	}
+	nerrors += CHECK(count == size, "iterated over %lld entries. expected %lld\n", 
+		(long long)count, (long long)size);
+	String_Map_del(map);
+
+	String_Map * set = String_Map_new(0, 10);
+	String_Map_put(set, &static_strings[10], NULL);
+	nerrors += CHECK(String_Map_get(set, &dynamic_strings[10]) && 
+		!String_Map_get(set, &static_strings[9]), "set membership was incorrect%s\n", "");
+	String_Map_del(set);
+
+	// values are packed value_size apart, and each map seeds its own hash so the same keys are laid
+	// out differently
+	String_Map * a = String_Map_new(12, 0);
+	String_Map * b = String_Map_new(12, 0);
+	_Bool packed = true;
+	for (int k = 0; k < 64; k++) {
+		char * value = String_Map_put(a, &keys[k], NULL);
+		String_Map_put(b, &keys[k], NULL);
+		packed &= !((value - (char *)String_Map_get(a, &keys[0])) % 12) && !((uintptr_t)value % 4);
+	}
+	_Bool same = true;
+	ptrdiff_t ia = 0;
+	ptrdiff_t ib = 0;
+	String kb;
+	while (String_Map_next(a, &ia, &key, NULL) && String_Map_next(b, &ib, &kb, NULL)) {
+		same &= String_data(&key) == String_data(&kb);
+	}
+	nerrors += CHECK(packed && !same, "maps were padded or shared a seed%s\n", "");
+	String_Map_del(a);
+	String_Map_del(b);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_Intern(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	String_Intern * pool = String_Intern_new();
+	String first, again;
+	String_intern(pool, &static_strings[10], &first);
+	String_intern(pool, &dynamic_strings[10], &again);
+	nerrors += CHECK(String_interned_equal(&first, &again) && String_data(&first) != String_data(&static_strings[10]) &&
+		!first.capacity && !String_compare(&first, &static_strings[10]),
+		"interning equal strings did not give the same handle%s\n", "");
+
+	// many distinct strings, some longer than a block, do not move earlier handles
+	enum {NKEYS = 5000};
+	static String handles[NKEYS];
+	char buf[3000];
+	for (int i = 0; i < NKEYS; i++) {
+		int n = sprintf(buf, "token-%d", i % (NKEYS / 2));
+		if (i % 1000 == 999) {
+			memset(buf + n, 'x', sizeof(buf) - n);
+			n = sizeof(buf);
+		}
+		String_intern(pool, &(String){.str = buf, .size = n}, &handles[i]);
+	}
+	String empty;
+	String_intern(pool, &static_strings[0], &empty);
+	nerrors += CHECK(NKEYS / 2 + 5 + 2 == String_Intern_len(pool),
+		"pool has %lld strings. expected %d\n", (long long)String_Intern_len(pool), NKEYS / 2 + 7);
+	for (int i = 0; i < NKEYS; i++) {
+		int n = sprintf(buf, "token-%d", i % (NKEYS / 2));
+		if (i % 1000 == 999) {
+			memset(buf + n, 'x', sizeof(buf) - n);
+			n = sizeof(buf);
+		}
+		String found;
+		nerrors += CHECK(String_Intern_find(pool, &(String){.str = buf, .size = n}, &found) &&
+			String_interned_equal(&found, &handles[i]) && !memcmp(String_data(&found), buf, n) && 
+			!String_data(&found)[n], "handle %d moved or changed\n", i);
+	}
+	nerrors += CHECK(String_interned_equal(&first, &again) && 
+		!String_compare(&first, &static_strings[10]), "the first handle moved or changed%s\n", "");
+	nerrors += CHECK(!String_Intern_find(pool, &(String){.str = "token-", .size = 6}, NULL),
+		"found a string that was never interned%s\n", "");
+	String_Intern_del(pool);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+enum {CINTERN_THREADS = 4, CINTERN_KEYS = 4000};
+
+typedef struct test_CInternWork {
+	String_ConcurrentIntern * pool;
+	String handles[CINTERN_KEYS];
+	unsigned stride;
+	int failures;
+} test_CInternWork;
+
+// interns every key, each thread in its own order
+static void * test_cintern_worker(void * arg) {
+	test_CInternWork * work = arg;
+	String_InternArena * arena = String_ConcurrentIntern_arena(work->pool);
+	char buf[32];
+	for (unsigned j = 0; j < CINTERN_KEYS; j++) {
+		unsigned k = j * work->stride % CINTERN_KEYS;
+		String key = {.str = buf, .size = sprintf(buf, "field-%u", k)};
+		work->failures += !arena || String_ConcurrentIntern_add(work->pool, arena, &key, 
+			&work->handles[k]);
+	}
+	return NULL;
+}
+
+int test_String_ConcurrentIntern(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	// a small first table forces keys into overflow tables
+	String_ConcurrentIntern * pool = String_ConcurrentIntern_new(1);
+	static test_CInternWork work[CINTERN_THREADS];
+	pthread_t threads[CINTERN_THREADS];
+	unsigned const strides[CINTERN_THREADS] = {1, 3, 7, 11}; // coprime to CINTERN_KEYS
+	for (int t = 0; t < CINTERN_THREADS; t++) {
+		work[t] = (test_CInternWork){.pool = pool, .stride = strides[t]};
+		nerrors += CHECK(!pthread_create(&threads[t], NULL, test_cintern_worker, &work[t]),
+			"failed to start thread %d\n", t);
+	}
+	for (int t = 0; t < CINTERN_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		nerrors += CHECK(!work[t].failures, "thread %d failed %d times\n", t, work[t].failures);
+	}
+	nerrors += CHECK(CINTERN_KEYS == String_ConcurrentIntern_len(pool),
+		"pool has %lld strings. expected %d\n", 
+		(long long)String_ConcurrentIntern_len(pool), CINTERN_KEYS);
+	char buf[32];
+	for (int k = 0; k < CINTERN_KEYS; k++) {
+		String key = {.str = buf, .size = sprintf(buf, "field-%d", k)};
+		String found = {0};
+		_Bool same = String_ConcurrentIntern_find(pool, &key, &found) && 
+			!String_compare(&found, &key) && !String_data(&found)[String_len(&found)];
+		for (int t = 0; t < CINTERN_THREADS; t++) {
+			same = same && String_interned_equal(&found, &work[t].handles[k]);
+		}
+		nerrors += CHECK(same, "threads disagree on the handle of %s\n", buf);
+	}
+	nerrors += CHECK(!String_ConcurrentIntern_find(pool, &(String){.str = "field-", .size = 6}, NULL),
+		"found a string that was never interned%s\n", "");
+	String_ConcurrentIntern_del(pool);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_Arena(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	String_Arena * arena = String_Arena_new(256);
+	String a = {0};
+	String b = {0};
+	String_init_arena(&a, arena, "abc", 3, 0);
+	String_init_arena(&b, arena, "def", 3, 0);
+	// b is the most recent allocation and grows in place. a has to move
+	char * b_buf = String_data(&b);
+	char * a_buf = String_data(&a);
+	String_extend(&b, &static_strings[10]);
+	String_extend(&a, &static_strings[10]);
+	nerrors += CHECK(String_data(&b) == b_buf && String_data(&a) != a_buf, 
+		"arena strings did not grow as expected%s\n", "");
+	nerrors += CHECK(!strncmp(String_data(&a), "abci am", 7) && !strncmp(String_data(&b), "defi am", 7) && 
+		String_len(&a) == 48 && String_len(&b) == 48, "arena strings have the wrong contents%s\n", "");
+	// an allocation larger than a block still works
+	String big = {0};
+	String_init_arena(&big, arena, NULL, 0, 1000);
+	nerrors += CHECK(String_data(&big) && String_capacity(&big) == 1000, "failed to allocate a large buffer%s\n", "");
+	String_dest(&big);
+
+	// split pieces and copies come from the arena in use
+	String_Arena * previous = String_Arena_use(arena);
+	String pieces[3] = {{0}};
+	String path = {.str = "path/to/file", .size = 12};
+	ptrdiff_t n = String_split(3, pieces, &path, &(String){.str = "/", .size = 1});
+	String copy = {0};
+	String_copy(&copy, &path);
+	nerrors += CHECK(3 == n && !String_compare(&pieces[2], &(String){.str = "file", .size = 4}) &&
+		!String_compare(&copy, &path), "arena split or copy is incorrect%s\n", "");
+	nerrors += CHECK(!previous && arena == String_Arena_use(previous), 
+		"String_Arena_use returned the wrong arena%s\n", "");
+
+	// the arena strings need not be destroyed one by one
+	String_Arena_reset(arena);
+	String_init_arena(&a, arena, "xyz", 3, 0);
+	nerrors += CHECK(!strncmp(String_data(&a), "xyz", 3), "failed to reuse the arena after reset%s\n", "");
+	String_Arena_del(arena);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+typedef struct test_Tracker {
+	ptrdiff_t live; // bytes
+	int calls;
+} test_Tracker;
+
+static void * test_track_alloc(void * ctx, size_t size) {
+	test_Tracker * tracker = ctx;
+	tracker->live += size;
+	tracker->calls++;
+	return malloc(size);
+}
+static void test_track_free(void * ctx, void * p, size_t size) {
+	test_Tracker * tracker = ctx;
+	tracker->live -= size;
+	tracker->calls++;
+	free(p);
+}
+
+// a tracking allocator without realloc sees every byte given back, whether it was set for the 
+// process, for one string or for the thread
+int test_String_Allocator(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	test_Tracker tracker = {0};
+	String_Allocator const tracking = {
+		.alloc = test_track_alloc, .free = test_track_free, .ctx = &tracker
+	};
+
+	String_Allocator const * previous = String_Allocator_set(&tracking);
+	String * str = String_new("a/b/c", 5, 0);
+	for (int i = 0; i < 100; i++) {
+		String_append(str, 'x');
+	}
+	String_replace(str, &(String){.str = "/", .size = 1}, &(String){.str = "//", .size = 2}, 0);
+	String pieces[4] = {{0}};
+	ptrdiff_t n = String_split(4, pieces, str, &(String){.str = "//", .size = 2});
+	nerrors += CHECK(tracker.live > 0 && tracker.calls > 5, 
+		"the process allocator was not used%s\n", "");
+	for (ptrdiff_t i = 0; i < n; i++) {
+		String_dest(&pieces[i]);
+	}
+	String_del(str);
+	String_Allocator_set(previous);
+	nerrors += CHECK(!tracker.live, "%lld bytes were not given back\n", (long long)tracker.live);
+
+	tracker.calls = 0;
+	String test = {0};
+	String_init_with(&test, &tracking, "abc", 3, 0);
+	String_extend(&test, &static_strings[10]);
+	String other = {0};
+	String_copy(&other, &test);
+	nerrors += CHECK(tracker.calls >= 2 && tracker.live > 0 && !String_compare(&test, &other),
+		"the string allocator was not used%s\n", "");
+	String_dest(&test);
+	nerrors += CHECK(!tracker.live, "%lld bytes were not given back\n", (long long)tracker.live);
+
+	tracker.calls = 0;
+	String_Allocator_use(&tracking);
+	String_lower_into(&test, &other);
+	String_Allocator_use(NULL);
+	nerrors += CHECK(1 == tracker.calls, "the thread allocator was not used%s\n", "");
+	String_dest(&test);
+	String_dest(&other);
+	nerrors += CHECK(!tracker.live, "%lld bytes were not given back\n", (long long)tracker.live);
+
+	// the capacity of a string with an allocator reads as the size of its buffer
+	String_init_with(&test, &tracking, "abc", 3, 40);
+	nerrors += CHECK(40 == String_capacity(&test) && tracker.live > 40, 
+		"reported a capacity of %zu for 40\n", String_capacity(&test));
+	String_dest(&test);
+
+	// Strings and buffers malloc'd by hand grow with realloc and are given back with free
+	String * hand = malloc(sizeof(*hand));
+	*hand = (String){.str = malloc(4), .size = 3, .capacity = 4};
+	memcpy(hand->str, "abc", 3);
+	String_extend(hand, &static_strings[10]);
+	String_shrink_to_fit(hand);
+	String shared = {0};
+	nerrors += CHECK(3 + String_len(&static_strings[10]) == String_len(hand) && !strncmp(String_data(hand), "abc", 3)
+		&& !String_share(&shared, hand) && String_data(&shared) == String_data(hand), 
+		"failed to grow or share a buffer from malloc%s\n", "");
+	String_dest(&shared);
+	String_del(hand);
+
+	// containers keep the allocator they were made with and give every byte back to it
+	tracker = (test_Tracker) {0};
+	String_Allocator_use(&tracking);
+	String_Map * map = String_Map_new(sizeof(int), 0);
+	String_Pattern * pat = String_Pattern_new(&static_strings[3]);
+	String_PatternSet * set = String_PatternSet_new(2, &static_strings[4]);
+	String_Builder * builder = String_Builder_new(8);
+	String_Rope * rope = String_Rope_new(&static_strings[10]);
+	String_Intern * pool = String_Intern_new();
+	String_ConcurrentIntern * cpool = String_ConcurrentIntern_new(0);
+	String_Allocator_use(NULL);
+	int made = tracker.calls;
+	String_InternArena * arena = cpool ? String_ConcurrentIntern_arena(cpool) : NULL;
+	char big[3000];
+	memset(big, 'x', sizeof(big));
+	String handle;
+	for (int i = 0; i < 100 && map && builder && rope && pool && arena; i++) {
+		String const * key = &static_strings[i % 11];
+		*(int *)String_Map_put(map, key, NULL) = i;
+		String_Builder_extend(builder, key);
+		String_intern(pool, key, &handle);
+		String_ConcurrentIntern_add(cpool, arena, key, &handle);
+		String_Rope_insert(rope, i, &(String){.str = big, .size = i * 30});
+	}
+	String_Rope_erase(rope, 10, 2000);
+	String_Rope * rest = String_Rope_split(rope, 500);
+	if (rest) {
+		String_Rope_concat(rope, rest);
+	}
+	nerrors += CHECK(map && pat && set && builder && rope && pool && arena && tracker.calls > made, 
+		"the containers did not use the allocator they were made with%s\n", "");
+	String_Map_del(map);
+	String_Pattern_del(pat);
+	String_PatternSet_del(set);
+	String_Builder_del(builder);
+	String_Rope_del(rope);
+	String_Intern_del(pool);
+	String_ConcurrentIntern_del(cpool);
+	nerrors += CHECK(!tracker.live, "%lld bytes of the containers were not given back\n", 
+		(long long)tracker.live);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// short strings live inside the String and move to the heap transparently as they grow
+int test_String_sso(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+	_Bool sso = STRING_SSO_CAPACITY > 0;
+	ptrdiff_t fill = sso ? (ptrdiff_t)STRING_SSO_CAPACITY : 8;
+
+	String test = {0};
+	String_init(&test, "a\tb", 3, 0);
+	nerrors += CHECK(String_is_inline(&test) == sso && !strcmp(String_data(&test), "a\tb"), 
+		"failed to store a short string inline%s\n", "");
+	// a copy of the struct carries its own bytes
+	String moved = test;
+	String_set(&test, 0, 'x');
+	nerrors += CHECK(!sso || (String_get(&moved, 0) == 'a' && String_get(&test, 0) == 'x'), 
+		"an inline copy shares its bytes%s\n", "");
+	String_set(&test, 0, 'a');
+	nerrors += CHECK(1 == String_expand_tabs(&test, 4) && 6 == String_len(&test) && 
+		!strncmp(String_data(&test), "a    b", 6) && String_is_inline(&test) == sso, 
+		"failed to expand tabs inline%s\n", "");
+	while (String_len(&test) < fill) {
+		String_append(&test, 'c');
+	}
+	nerrors += CHECK(String_is_inline(&test) == sso, "spilled to the heap too early%s\n", "");
+	String_append(&test, 'd');
+	String_extend(&test, &static_strings[10]);
+	char * cstr = String_cstr(&test);
+	nerrors += CHECK(!String_is_inline(&test) && cstr == String_data(&test) && 
+		!strncmp(cstr, "a    bc", 7) && cstr[fill] == 'd' && 
+		!strcmp(cstr + fill + 1, String_data(&static_strings[10])), 
+		"failed to spill to the heap%s\n", "");
+	String_dest(&test);
+
+	// the bytes fill the whole String: the length shares the last byte with the flag
+	String_init(&test, "0123456789abcdefghijkl", 22, 0);
+	nerrors += CHECK(String_is_inline(&test) == sso && 22 == String_len(&test) && 
+		!strcmp(String_cstr(&test), "0123456789abcdefghijkl") && String_is_inline(&test) == sso, 
+		"failed to fill the inline bytes%s\n", "");
+	String_dest(&test);
+
+	// split pieces of a short field need no allocation and replace crosses the boundary both ways
+	String pieces[3] = {{0}};
+	String line = {.str = "key=value=x", .size = 11};
+	nerrors += CHECK(3 == String_split(3, pieces, &line, &(String){.str = "=", .size = 1}) &&
+		String_is_inline(&pieces[1]) == sso && !strcmp(String_data(&pieces[1]), "value"), 
+		"failed to split into inline pieces%s\n", "");
+	String_replace(&pieces[1], &(String){.str = "a", .size = 1}, 
+		&(String){.str = "aaaaaaaaaaaaaaaaaaaa", .size = 20}, 0);
+	nerrors += CHECK(!String_is_inline(&pieces[1]) && 24 == String_len(&pieces[1]) && 
+		!strncmp(String_data(&pieces[1]), "vaaaaaaaaaaaaaaaaaaaalue", 24), "failed to grow by replace%s\n", "");
+	String_replace(&pieces[0], &(String){.str = "ey", .size = 2}, &(String){.str = "", .size = 0}, 0);
+	nerrors += CHECK(String_is_inline(&pieces[0]) == sso && 1 == String_len(&pieces[0]) && 
+		'k' == String_get(&pieces[0], 0), "failed to shrink by replace%s\n", "");
+	for (int i = 0; i < 3; i++) {
+		String_dest(&pieces[i]);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_reserve(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	// growing one byte at a time takes a logarithmic number of allocations
+	test_Tracker tracker = {0};
+	String_Allocator const tracking = {
+		.alloc = test_track_alloc, .free = test_track_free, .ctx = &tracker
+	};
+	String test = {0};
+	String_init_with(&test, &tracking, "x", 1, 0);
+	for (int i = 0; i < 10000; i++) {
+		String_extend(&test, &(String){.str = "y", .size = 1});
+	}
+	nerrors += CHECK(10001 == String_len(&test) && tracker.calls < 64, 
+		"extend made %d allocator calls\n", tracker.calls);
+	nerrors += CHECK(!String_shrink_to_fit(&test) && 10001 == String_capacity(&test) && 
+		'y' == String_get(&test, 10000), "failed to shrink to fit%s\n", "");
+	String_dest(&test);
+	nerrors += CHECK(!tracker.live, "%lld bytes were not given back\n", (long long)tracker.live);
+
+	nerrors += CHECK(!String_reserve(&test, 100) && String_capacity(&test) >= 100 && 
+		!String_reserve(&test, 10) && String_capacity(&test) >= 100, "failed to reserve%s\n", "");
+	nerrors += CHECK(-1 == String_reserve(&test, SIZE_MAX), "reserved an impossible size%s\n", "");
+	String_extend(&test, &static_strings[10]);
+	String_dest(&test);
+
+	// a view is copied before it is written to, starting from capacity 0
+	char buf[] = "abc";
+	String view = {.str = buf, .size = 3};
+	nerrors += CHECK(!String_append(&view, 'd') && String_data(&view) != buf && !strcmp(buf, "abc") &&
+		4 == String_len(&view) && !strncmp(String_data(&view), "abcd", 4), 
+		"failed to append to a view%s\n", "");
+	String_dest(&view);
+	view = (String){.str = buf, .size = 3};
+	char * cstr = String_cstr(&view);
+	nerrors += CHECK(cstr && cstr != buf && !strcmp(cstr, "abc"), "failed to terminate a view%s\n", "");
+	String_dest(&view);
+	String empty = {0};
+	nerrors += CHECK(!String_append(&empty, 'a') && 1 == String_len(&empty) && String_capacity(&empty) >= 1, 
+		"failed to append to an empty string%s\n", "");
+	String_dest(&empty);
+
+	// a large string shrunk to a few bytes moves inline
+	String_init(&test, NULL, 0, 1000);
+	String_extend(&test, &(String){.str = "short", .size = 5});
+	nerrors += CHECK(!String_shrink_to_fit(&test) && 
+		String_capacity(&test) == (STRING_SSO_CAPACITY ? STRING_SSO_CAPACITY : 5) && 
+		!strncmp(String_data(&test), "short", 5), "failed to shrink a small string%s\n", "");
+	String_dest(&test);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_Builder(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	// small chunks so that appends straddle chunk boundaries
+	String_Builder * builder = String_Builder_new(16);
+	char expected[4096];
+	ptrdiff_t size = 0;
+	for (int i = 0; i < 40; i++) {
+		String const * piece = &static_strings[i % 11];
+		String_Builder_extend(builder, piece);
+		memcpy(expected + size, String_data(piece), String_len(piece));
+		size += String_len(piece);
+		String_Builder_append(builder, '|');
+		expected[size++] = '|';
+		int n = String_Builder_appendf(builder, "%d:%s;", i * 37, i % 2 ? "odd" : "even");
+		nerrors += CHECK(n == snprintf(expected + size, sizeof(expected) - size, "%d:%s;", i * 37, 
+			i % 2 ? "odd" : "even"), "appendf returned %d\n", n);
+		size += n;
+	}
+	String test = {0};
+	nerrors += CHECK(!String_Builder_build(builder, &test) && size == String_Builder_len(builder) &&
+		size == String_len(&test) && !memcmp(String_data(&test), expected, size), 
+		"failed to build %.*s\n", (int)size, expected);
+	String_dest(&test);
+
+	// the views cover the same bytes in order
+	String views[1024];
+	ptrdiff_t nviews = String_Builder_views(builder, 1024, views);
+	ptrdiff_t offset = 0;
+	_Bool same = nviews > 1 && nviews <= 1024;
+	for (ptrdiff_t i = 0; same && i < nviews; i++) {
+		same = !views[i].capacity && !memcmp(String_data(&views[i]), expected + offset, String_len(&views[i]));
+		offset += String_len(&views[i]);
+	}
+	nerrors += CHECK(same && offset == size, "the views do not match the appends%s\n", "");
+
+	// a long formatted append gets a chunk of its own and clearing reuses the builder
+	String_Builder_clear(builder);
+	nerrors += CHECK(!String_Builder_len(builder) && !String_Builder_build(builder, &test) && 
+		!String_len(&test), "failed to clear%s\n", "");
+	String_Builder_append(builder, 'x');
+	String_Builder_appendf(builder, "%s%s", String_data(&static_strings[10]), 
+		String_data(&static_strings[10]));
+	String_Builder_build(builder, &test);
+	nerrors += CHECK(1 + 2 * String_len(&static_strings[10]) == String_len(&test) && 'x' == String_get(&test, 0) &&
+		!strncmp(String_data(&test) + 1, String_data(&static_strings[10]), String_len(&static_strings[10])),
+		"failed to format a long append%s\n", "");
+	String_dest(&test);
+	String_Builder_del(builder);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// random edits on a rope and on a flat copy must agree
+int test_String_Rope(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	enum {MAX_SIZE = 1 << 16};
+	static char flat[MAX_SIZE];
+	static char buf[MAX_SIZE];
+	ptrdiff_t size = 5000;
+	test_rand_fill(flat, size, 3);
+	String_Rope * rope = String_Rope_new(&(String){.str = flat, .size = size});
+	for (int trial = 0; trial < 3000 && !nerrors; trial++) {
+		int op = test_rand() % 8;
+		if (op < 4) { // mostly small inserts with the odd large one
+			ptrdiff_t n = 1 + test_rand() % (op ? 16 : 3000);
+			ptrdiff_t loc = test_rand() % (size + 1);
+			if (size + n > MAX_SIZE) {
+				continue;
+			}
+			test_rand_fill(buf, n, 3);
+			nerrors += CHECK(!String_Rope_insert(rope, loc, &(String){.str = buf, .size = n}), 
+				"failed to insert %lld bytes\n", (long long)n);
+			memmove(flat + loc + n, flat + loc, size - loc);
+			memcpy(flat + loc, buf, n);
+			size += n;
+		} else if (op < 7) {
+			ptrdiff_t start = test_rand() % (size + 1);
+			ptrdiff_t end = start + test_rand() % (op == 6 ? 4000 : 20);
+			end = end > size ? size : end;
+			nerrors += CHECK(!String_Rope_erase(rope, start, end), "failed to erase%s\n", "");
+			memmove(flat + start, flat + end, size - end);
+			size -= end - start;
+		} else { // cut in two and glue back together
+			ptrdiff_t loc = test_rand() % (size + 1);
+			String_Rope * rest = String_Rope_split(rope, loc);
+			nerrors += CHECK(rest && loc == String_Rope_len(rope) && 
+				size - loc == String_Rope_len(rest) && !String_Rope_concat(rope, rest), 
+				"failed to split and concat at %lld\n", (long long)loc);
+		}
+		ptrdiff_t loc = size ? test_rand() % size : 0;
+		nerrors += CHECK(size == String_Rope_len(rope) && (!size || 
+			flat[loc] == String_Rope_get(rope, loc)), "rope and flat copy differ at %lld\n", 
+			(long long)loc);
+	}
+	// the chunks and a copy reproduce the text
+	ptrdiff_t pos = 0;
+	ptrdiff_t nchunks = 0;
+	_Bool same = true;
+	String chunk;
+	while (same && String_Rope_next(rope, &pos, &chunk)) {
+		same = !memcmp(flat + pos - String_len(&chunk), String_data(&chunk), String_len(&chunk));
+		nchunks++;
+	}
+	String copy = {0};
+	nerrors += CHECK(same && pos == size && nchunks > 1 && !String_Rope_copy(rope, 0, 0, &copy) && 
+		size == String_len(&copy) && !memcmp(String_data(&copy), flat, size), 
+		"the rope does not match its flat copy%s\n", "");
+	String_dest(&copy);
+
+	// searches across leaves against the flat copy
+	for (int trial = 0; trial < 300; trial++) {
+		ptrdiff_t m = 1 + test_rand() % (trial % 10 ? 8 : 1500);
+		ptrdiff_t start = test_rand() % size;
+		ptrdiff_t from = test_rand() % size;
+		memcpy(buf, flat + from, from + m <= size ? m : size - from);
+		if (from + m > size) {
+			m = size - from;
+		}
+		String sub = {.str = buf, .size = m};
+		ptrdiff_t expected = naive_find(flat + start, size - start, buf, m);
+		expected = expected < 0 ? -1 : start + expected;
+		ptrdiff_t loc = String_Rope_find(rope, &sub, start, 0);
+		nerrors += CHECK(loc == expected, "found %lld instead of %lld\n", (long long)loc, 
+			(long long)expected);
+		if (m <= 3 || m > 1000) {
+			int count = 0;
+			for (ptrdiff_t i = naive_find(flat, size, buf, m); i >= 0; ) {
+				count++;
+				ptrdiff_t next = naive_find(flat + i + m, size - i - m, buf, m);
+				i = next < 0 ? -1 : i + m + next;
+			}
+			nerrors += CHECK(count == String_Rope_count(rope, &sub, 0, 0), 
+				"counted the wrong number of %.*s\n", (int)m, buf);
+		}
+	}
+	String_Rope_del(rope);
+
+	// needles longer than a leaf, counted back to back and across leaves
+	memset(flat, 'a', 20000);
+	rope = String_Rope_new(NULL);
+	for (ptrdiff_t loc = 0; loc < 20000; loc += 700) {
+		ptrdiff_t n = loc + 700 < 20000 ? 700 : 20000 - loc;
+		nerrors += CHECK(!String_Rope_insert(rope, loc, &(String){.str = flat, .size = n}),
+			"failed to insert %lld bytes\n", (long long)n);
+	}
+	int count = String_Rope_count(rope, &(String){.str = flat, .size = 3000}, 0, 0);
+	nerrors += CHECK(6 == count, "counted %d runs of 3000 bytes in 20000. expected 6\n", count);
+	count = String_Rope_count(rope, &(String){.str = flat, .size = 1999}, 500, 0);
+	nerrors += CHECK(9 == count, "counted %d runs of 1999 bytes in 19500. expected 9\n", count);
+	ptrdiff_t loc = String_Rope_find(rope, &(String){.str = flat, .size = 20000}, 0, 0);
+	nerrors += CHECK(!loc, "found the whole rope at %lld\n", (long long)loc);
+	String_Rope_del(rope);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+enum {SHARE_THREADS = 4};
+
+// each consumer changes its own share of the payload
+static void * test_share_worker(void * arg) {
+	String * share = arg;
+	String_upper(share);
+	String_append(share, '!');
+	return NULL;
+}
+
+int test_String_share(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	test_Tracker tracker = {0};
+	String_Allocator const tracking = {
+		.alloc = test_track_alloc, .free = test_track_free, .ctx = &tracker
+	};
+	String_Allocator const * previous = String_Allocator_set(&tracking);
+	String payload = {0};
+	String_copy(&payload, &static_strings[10]);
+	ptrdiff_t size = String_len(&payload);
+	int calls = tracker.calls;
+	String a, b, slice;
+	nerrors += CHECK(!String_share(&a, &payload) && !String_share(&b, &a) && 
+		!String_share_slice(&slice, &payload, 2, 6) && calls + 1 == tracker.calls &&
+		String_data(&a) == String_data(&payload) && String_data(&b) == String_data(&payload) &&
+		String_data(&slice) == String_data(&payload) + 2 && 4 == String_len(&slice) && 
+		String_is_shared(&payload) && !String_capacity(&a), "failed to share the buffer%s\n", "");
+
+	// writes give the writer a private copy
+	String_set(&a, 0, 'X');
+	String_upper(&slice);
+	nerrors += CHECK(String_data(&a) != String_data(&payload) && 'X' == String_get(&a, 0) && 
+		'i' == String_get(&payload, 0) && !String_is_shared(&a) && 
+		!strncmp(String_data(&slice), "AM T", 4) && !strncmp(String_data(&payload) + 2, "am t", 4),
+		"a write changed the shared bytes%s\n", "");
+	String_replace(&b, &(String){.str = "am", .size = 2}, &(String){.str = "was", .size = 3}, 1);
+	String_lstrip(&payload, &(String){.str = "i", .size = 1});
+	nerrors += CHECK(!strncmp(String_data(&b), "i was", 5) && !strncmp(String_data(&payload), " am", 3)
+		&& size - 1 == String_len(&payload), "failed to replace or strip a shared string%s\n", "");
+
+	// the last owner takes the buffer back instead of copying and only gives back the control block
+	String_dest(&a);
+	String_dest(&slice);
+	String_share(&a, &b);
+	String_dest(&b);
+	calls = tracker.calls;
+	String_set(&a, 0, 'I');
+	nerrors += CHECK(calls + 1 == tracker.calls && !String_is_shared(&a) && 'I' == String_get(&a, 0),
+		"the last owner copied the buffer%s\n", "");
+	String_dest(&a);
+	String_dest(&payload);
+	String_Allocator_set(previous);
+	nerrors += CHECK(!tracker.live, "%lld bytes were not given back\n", (long long)tracker.live);
+
+	// inline strings and views are copied
+	String view = {.str = "short", .size = 5};
+	nerrors += CHECK(!String_share(&a, &view) && String_data(&a) != String_data(&view) && 
+		!String_is_shared(&a) && !String_compare(&a, &view), "failed to copy a view%s\n", "");
+	String_dest(&a);
+
+	// consumers in other threads detach independently
+	String_copy(&payload, &static_strings[10]);
+	String shares[SHARE_THREADS];
+	pthread_t threads[SHARE_THREADS];
+	for (int t = 0; t < SHARE_THREADS; t++) {
+		String_share(&shares[t], &payload);
+		nerrors += CHECK(!pthread_create(&threads[t], NULL, test_share_worker, &shares[t]),
+			"failed to start thread %d\n", t);
+	}
+	String_dest(&payload);
+	for (int t = 0; t < SHARE_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		nerrors += CHECK(size + 1 == String_len(&shares[t]) && !strncmp(String_data(&shares[t]), "I AM", 4) &&
+			'!' == String_get(&shares[t], -1), "thread %d has the wrong string\n", t);
+		String_dest(&shares[t]);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+// writes in place give a view its own copy and leave the borrowed bytes alone
+int test_String_view_writes(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	char const * literal = "Hello abab world";
+	String view = {.str = (char *)literal, .size = 16};
+	String_lower(&view);
+	nerrors += CHECK(!String_compare(&view, &(String){.str = "hello abab world", .size = 16}) && 
+		String_data(&view) != literal, "failed to lower a view%s\n", "");
+	String_dest(&view);
+	view = (String){.str = (char *)literal, .size = 16};
+	String_upper(&view);
+	nerrors += CHECK(!String_compare(&view, &(String){.str = "HELLO ABAB WORLD", .size = 16}), 
+		"failed to upper a view%s\n", "");
+	String_dest(&view);
+	view = (String){.str = (char *)literal, .size = 16};
+	unsigned char table[256];
+	String_maketrans(table, &(String){.str = "ab", .size = 2}, &(String){.str = "xy", .size = 2});
+	String_translate(&view, table, NULL);
+	nerrors += CHECK(!String_compare(&view, &(String){.str = "Hello xyxy world", .size = 16}), 
+		"failed to translate a view%s\n", "");
+	String_dest(&view);
+	view = (String){.str = (char *)literal, .size = 16};
+	nerrors += CHECK(2 == String_replace(&view, &(String){.str = "ab", .size = 2}, 
+		&(String){.str = "c", .size = 1}, 0) && 
+		!String_compare(&view, &(String){.str = "Hello cc world", .size = 14}), 
+		"failed to shrink a view by replacing%s\n", "");
+	String_dest(&view);
+	view = (String){.str = (char *)literal, .size = 16};
+	String_set(&view, 0, 'J');
+	nerrors += CHECK('J' == String_get(&view, 0), "failed to set a char of a view%s\n", "");
+	String_dest(&view);
+
+	// the pieces of a split borrow the source
+	char source[] = "one,Two,three";
+	String str = {.str = source, .size = 13};
+	String_SplitIter it;
+	String_SplitIter_init(&it, &str, &(String){.str = ",", .size = 1}, -1, false);
+	String piece;
+	while (String_SplitIter_next(&it, &piece)) {
+		String_upper(&piece);
+		String_replace(&piece, &(String){.str = "O", .size = 1}, &(String){.str = "", .size = 0}, 0);
+		String_dest(&piece);
+	}
+	nerrors += CHECK(!strcmp(source, "one,Two,three"), "writing a piece changed the source to %s\n", 
+		source);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_find_all(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	char hay[300];
+	char needle[8];
+	ptrdiff_t expected[300];
+	ptrdiff_t locs[300];
+	for (int trial = 0; trial < 2000; trial++) {
+		ptrdiff_t n = 1 + test_rand() % sizeof(hay);
+		ptrdiff_t m = 1 + test_rand() % sizeof(needle);
+		unsigned nalpha = 1 + test_rand() % 3;
+		_Bool overlap = test_rand() % 2;
+		test_rand_fill(hay, n, nalpha);
+		test_rand_fill(needle, m, nalpha);
+		String str = {.str = hay, .size = n};
+		String sub = {.str = needle, .size = m};
+
+		ptrdiff_t nexpected = 0;
+		for (ptrdiff_t loc = naive_find(hay, n, needle, m); loc >= 0; ) {
+			expected[nexpected++] = loc;
+			ptrdiff_t from = loc + (overlap ? 1 : m);
+			ptrdiff_t next = naive_find(hay + from, n - from, needle, m);
+			loc = next < 0 ? -1 : from + next;
+		}
+
+		// read back in small batches to exercise resuming
+		ptrdiff_t batch = 1 + test_rand() % 5;
+		ptrdiff_t nlocs = 0;
+		ptrdiff_t start = 0;
+		ptrdiff_t found = batch;
+		while (found == batch && start < n) {
+			found = String_find_all(&str, &sub, start, n, overlap, locs + nlocs, batch);
+			nlocs += found;
+			if (found) {
+				start = locs[nlocs - 1] + (overlap ? 1 : m);
+			}
+		}
+		nerrors += CHECK(nexpected == nlocs && !memcmp(expected, locs, nlocs * sizeof(*locs)),
+			"failed to find all %s %.*s in '%.*s'. expected %lld, found %lld\n",
+			overlap ? "overlapping" : "non-overlapping", (int)m, needle, (int)n, hay,
+			(long long)nexpected, (long long)nlocs);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
 int test_String_lstrip(void) {
 	verbose_start(__func__);
 	int nerrors = 0;
@@ -661,7 +2182,7 @@ int test_String_lstrip(void) {
 
 	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)str_result, .size = strlen(str_result)}),
 		"failed to strip from left and right. expected %s, found %.*s\n",
-		str_result, (int)test.size, test.str);
+		str_result, (int)String_len(&test), String_data(&test));
 
 	String_dest(&test);
 	verbose_end(nerrors);
@@ -679,7 +2200,7 @@ int test_String_rstrip(void) {
 
 	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)str_result, .size = strlen(str_result)}),
 		"failed to strip from left and right. expected %s, found %.*s\n",
-		str_result, (int)test.size, test.str);
+		str_result, (int)String_len(&test), String_data(&test));
 
 	String_dest(&test);
 	verbose_end(nerrors);
@@ -697,7 +2218,7 @@ int test_String_strip(void) {
 	
 	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)str_result, .size = strlen(str_result)}),
 		"failed to strip from left and right. expected %s, found %.*s\n",
-		str_result, (int)test.size, test.str);
+		str_result, (int)String_len(&test), String_data(&test));
 
 	String_dest(&test);
 	verbose_end(nerrors);
@@ -718,18 +2239,133 @@ int test_String_rpartition(void) {
 
 	nerrors += CHECK(!String_compare(&path, &path_result),
 		"failed to retrieve prefix in rpartition. expected %.*s, found %.*s\n",
-		(int)path_result.size, path_result.str,
-		(int)path.size, path.str);
+		(int)String_len(&path_result), String_data(&path_result),
+		(int)String_len(&path), String_data(&path));
 	nerrors += CHECK(!String_compare(&file, &file_result),
 		"failed to retrieve suffix in rpartition. expected %.*s, found %.*s\n",
-		(int)file_result.size, file_result.str,
-		(int)file.size, file.str);
+		(int)String_len(&file_result), String_data(&file_result),
+		(int)String_len(&file), String_data(&file));
 	
 	String_dest(&file);
+
+	// separator as the last character
+	char const * dir_raw = "path/to/";
+	String const dir_result = {.str = "path/to", .size = 7};
+	String dir = {.str = (char *)dir_raw, .size = strlen(dir_raw)};
+	String rest = {0};
+	String_rpartition(&dir, &sep, &rest);
+	nerrors += CHECK(!String_compare(&dir, &dir_result),
+		"failed to retrieve prefix in rpartition. expected %.*s, found %.*s\n",
+		(int)String_len(&dir_result), String_data(&dir_result),
+		(int)String_len(&dir), String_data(&dir));
+	nerrors += CHECK(String_is_empty(&rest),
+		"failed to retrieve suffix in rpartition. expected empty string, found %.*s\n",
+		(int)String_len(&rest), String_data(&rest));
+
+	String_dest(&rest);
 	verbose_end(nerrors);
 	return nerrors;	
 }
 
+int test_String_span(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	String_CharSet set;
+	String_CharSet_init(&set, &WHITESPACE);
+	nerrors += CHECK(!memcmp(&set, &WHITESPACE_SET, sizeof(set)),
+		"WHITESPACE_SET does not match the characters in WHITESPACE%s\n", "");
+
+	char const * levels[] = {"scalar", "ssse3", "avx2"};
+	char buf[200];
+	char chars[8];
+	for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+		if (String_simd_select(levels[l])) {
+			continue;
+		}
+		for (int trial = 0; trial < 2000; trial++) {
+			// small alphabets over the whole byte range make long spans likely
+			unsigned char base = test_rand() % 256;
+			unsigned nalpha = 2 + test_rand() % 6;
+			ptrdiff_t n = test_rand() % sizeof(buf);
+			ptrdiff_t nchars = 1 + test_rand() % sizeof(chars);
+			for (ptrdiff_t i = 0; i < n; i++) {
+				buf[i] = (char)(base + 37 * (test_rand() % nalpha));
+			}
+			for (ptrdiff_t i = 0; i < nchars; i++) {
+				chars[i] = (char)(base + 37 * (test_rand() % nalpha));
+			}
+			String str = {.str = buf, .size = n};
+			String_CharSet_init(&set, &(String){.str = chars, .size = nchars});
+			ptrdiff_t span = 0;
+			while (span < n && memchr(chars, buf[span], nchars)) {
+				span++;
+			}
+			ptrdiff_t cspan = 0;
+			while (cspan < n && !memchr(chars, buf[cspan], nchars)) {
+				cspan++;
+			}
+			ptrdiff_t rspan = 0;
+			while (rspan < n && memchr(chars, buf[n - 1 - rspan], nchars)) {
+				rspan++;
+			}
+			nerrors += CHECK(span == String_span(&str, &set),
+				"%s: String_span mismatch. expected %lld, found %lld\n", levels[l],
+				(long long)span, (long long)String_span(&str, &set));
+			nerrors += CHECK(cspan == String_cspan(&str, &set),
+				"%s: String_cspan mismatch. expected %lld, found %lld\n", levels[l],
+				(long long)cspan, (long long)String_cspan(&str, &set));
+			nerrors += CHECK(rspan == String_rspan(&str, &set),
+				"%s: String_rspan mismatch. expected %lld, found %lld\n", levels[l],
+				(long long)rspan, (long long)String_rspan(&str, &set));
+		}
+	}
+	String_simd_select(NULL);
+
+	// the whitespace kernels against the generic set, with the neighbours of the whitespace bytes
+	char const alphabet[] = " \t\n\v\f\r\b\x0e\x1f!a\xa0\x89\x8d";
+	char const * ws_levels[] = {"scalar", "sse2", "avx2"};
+	String_CharSet_init(&set, &WHITESPACE);
+	for (size_t l = 0; l < sizeof(ws_levels) / sizeof(ws_levels[0]); l++) {
+		if (String_simd_select(ws_levels[l])) {
+			continue;
+		}
+		for (int trial = 0; trial < 2000; trial++) {
+			ptrdiff_t n = test_rand() % sizeof(buf);
+			unsigned nws = 1 + test_rand() % 6;
+			for (ptrdiff_t i = 0; i < n; i++) {
+				unsigned k = test_rand() % (sizeof(alphabet) - 1 + nws);
+				buf[i] = alphabet[k < sizeof(alphabet) - 1 ? k : k % 6];
+			}
+			String str = {.str = buf, .size = n};
+			nerrors += CHECK(String_span(&str, &set) == String_span(&str, &WHITESPACE_SET),
+				"%s: whitespace span mismatch. expected %lld, found %lld\n", ws_levels[l],
+				(long long)String_span(&str, &set), (long long)String_span(&str, &WHITESPACE_SET));
+			nerrors += CHECK(String_cspan(&str, &set) == String_cspan(&str, &WHITESPACE_SET),
+				"%s: whitespace cspan mismatch. expected %lld, found %lld\n", ws_levels[l],
+				(long long)String_cspan(&str, &set), (long long)String_cspan(&str, &WHITESPACE_SET));
+			nerrors += CHECK(String_rspan(&str, &set) == String_rspan(&str, &WHITESPACE_SET),
+				"%s: whitespace rspan mismatch. expected %lld, found %lld\n", ws_levels[l],
+				(long long)String_rspan(&str, &set), (long long)String_rspan(&str, &WHITESPACE_SET));
+		}
+	}
+	String_simd_select(NULL);
+
+	char const * str_orig = "xxyHello, Worldyxy";
+	char const * str_result = "Hello, World";
+	String test;
+	String_init(&test, str_orig, strlen(str_orig), 0);
+	String_CharSet_init(&set, &(String){.str = "xy", .size = 2});
+	String_strip_set(&test, &set);
+	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)str_result, .size = strlen(str_result)}),
+		"failed to strip 'xy' from left and right. expected %s, found %.*s\n",
+		str_result, (int)String_len(&test), String_data(&test));
+	String_dest(&test);
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
 int test_String_partition(void) {
 	verbose_start(__func__);
 	int nerrors = 0;
@@ -744,12 +2380,12 @@ int test_String_partition(void) {
 
 	nerrors += CHECK(!String_compare(&path, &path_result),
 		"failed to retrieve prefix in rpartition. expected %.*s, found %.*s\n",
-		(int)path_result.size, path_result.str,
-		(int)path.size, path.str);
+		(int)String_len(&path_result), String_data(&path_result),
+		(int)String_len(&path), String_data(&path));
 	nerrors += CHECK(!String_compare(&file, &file_result),
 		"failed to retrieve suffix in rpartition. expected %.*s, found %.*s\n",
-		(int)file_result.size, file_result.str,
-		(int)file.size, file.str);
+		(int)String_len(&file_result), String_data(&file_result),
+		(int)String_len(&file), String_data(&file));
 
 	String_dest(&file);
 	verbose_end(nerrors);
@@ -775,7 +2411,7 @@ int test_String_expand_tabs(void) {
 
 	nerrors += CHECK(!String_compare(&result, &(String){.str = (char *)cresult, .size = strlen(cresult)}),
 		"failed to expand tabs properly 1 tab = %d spaces. expected %s, found %.*s\n",
-		4, cresult, (int)result.size, result.str);
+		4, cresult, (int)String_len(&result), String_data(&result));
 
 	String_dest(&result);
 	verbose_end(nerrors);
@@ -794,7 +2430,7 @@ int test_String_append(void) {
 
 	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)hw, .size = strlen(hw)}),
 		"failed to append to string. expected %s, found %.*s\n",
-		hw, (int)test.size, test.str);
+		hw, (int)String_len(&test), String_data(&test));
 
 	String_dest(&test);
 
@@ -817,7 +2453,7 @@ int test_String_extend(void) {
 
 	nerrors += CHECK(!String_compare(&a, &(String){.str = (char *)hw, .size = strlen(hw)}),
 		"failed to extend %s to %s. expected %s, found %.*s\n",
-		h, w, hw, (int)a.size, a.str);
+		h, w, hw, (int)String_len(&a), String_data(&a));
 
 	String_dest(&a);
 	verbose_end(nerrors);
@@ -844,9 +2480,9 @@ int test_String_replace(void) {
 
 	nerrors += CHECK(!String_compare(&test, &result),
 		"failed to replace all %c with %c. expected %s, found %.*s\n",
-		'/', '\\', path_result, (int)test.size, test.str);
+		'/', '\\', path_result, (int)String_len(&test), String_data(&test));
 
-	String_init(&test, path_raw, strlen(path_raw), test.capacity);
+	String_init(&test, path_raw, strlen(path_raw), String_capacity(&test));
 
 	nerrors += CHECK(1 == String_replace(&test, &sep, &rep, 1),
 		"failed to replace all %c with %c. expected %d, found %d\n",
@@ -854,8 +2490,72 @@ int test_String_replace(void) {
 
 	nerrors += CHECK(!String_compare(&test, &result1),
 		"failed to replace all %c with %c. expected %s, found %.*s\n",
-		'/', '\\', path_result1, (int)test.size, test.str);
+		'/', '\\', path_result1, (int)String_len(&test), String_data(&test));
+
+	struct {
+		char const * src;
+		char const * old;
+		char const * new;
+		int count;
+		char const * result;
+	} cases[] = {
+		{"path/to/file", "/", "::", 0, "path::to::file"},
+		{"path::to::file", "::", "/", 0, "path/to/file"},
+		{"path::to::file", "::", "", 1, "pathto::file"},
+		{"aaaaa", "aa", "b", 0, "bba"},
+		{"aaaaa", "aa", "ccc", 0, "cccccca"},
+		{"no match", "x", "yy", 0, "no match"},
+		{"a.b.c.d", ".", "--", 2, "a--b--c.d"},
+		{"a--b--c--d", "--", ".", 2, "a.b.c--d"},
+		{"", "x", "yy", 0, ""},
+	};
+	String out = {0};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		String src = {.str = (char *)cases[i].src, .size = strlen(cases[i].src)};
+		String old = {.str = (char *)cases[i].old, .size = strlen(cases[i].old)};
+		String new = {.str = (char *)cases[i].new, .size = strlen(cases[i].new)};
+		String expected = {.str = (char *)cases[i].result, .size = strlen(cases[i].result)};
+		String_init(&test, cases[i].src, String_len(&src), String_capacity(&test));
+		String_replace(&test, &old, &new, cases[i].count);
+		nerrors += CHECK(!String_compare(&test, &expected),
+			"failed to replace %s with %s in %s. expected %s, found %.*s\n",
+			cases[i].old, cases[i].new, cases[i].src, cases[i].result, (int)String_len(&test), String_data(&test));
+		String_replace_into(&out, &src, &old, &new, cases[i].count);
+		nerrors += CHECK(!String_compare(&out, &expected),
+			"failed to replace %s with %s in %s into new string. expected %s, found %.*s\n",
+			cases[i].old, cases[i].new, cases[i].src, cases[i].result, (int)String_len(&out), String_data(&out));
+	}
 
+	// many matches across several search batches, growing and shrinking
+	char big[1000];
+	char grown[1500];
+	for (int i = 0; i < 500; i++) {
+		memcpy(big + 2 * i, "a,", 2);
+		memcpy(grown + 3 * i, "a;;", 3);
+	}
+	String big_str = {.str = big, .size = sizeof(big)};
+	String grown_str = {.str = grown, .size = sizeof(grown)};
+	String comma = {.str = ",", .size = 1};
+	String semis = {.str = ";;", .size = 2};
+	String_init(&test, big, sizeof(big), String_capacity(&test));
+	nerrors += CHECK(500 == String_replace(&test, &comma, &semis, 0) && 
+		!String_compare(&test, &grown_str), "failed to replace 500 matches in place\n", "");
+	nerrors += CHECK(500 == String_replace(&test, &semis, &comma, 0) && 
+		!String_compare(&test, &big_str), "failed to shrink 500 matches in place\n", "");
+	nerrors += CHECK(500 == String_replace_into(&out, &big_str, &comma, &semis, 0) && 
+		!String_compare(&out, &grown_str), "failed to replace 500 matches into new string\n", "");
+	nerrors += CHECK(100 == String_replace_into(&out, &big_str, &comma, &semis, 100) && 
+		String_len(&out) == (ptrdiff_t)sizeof(big) + 100, "failed to replace 100 of 500 matches\n", "");
+
+	// a fresh dest with nothing to copy has no buffer to copy into
+	String_dest(&out);
+	nerrors += CHECK(1 == String_replace_into(&out, &comma, &comma, &(String){.str = "", .size = 0}, 0) && 
+		!String_len(&out), "failed to replace the whole string with nothing%s\n", "");
+	String_dest(&out);
+	nerrors += CHECK(!String_replace_into(&out, &(String){.str = "", .size = 0}, &comma, &semis, 0) && 
+		!String_len(&out), "failed to replace in an empty string%s\n", "");
+
+	String_dest(&out);
 	String_dest(&test);
 	verbose_end(nerrors);
 	return nerrors;
@@ -891,10 +2591,144 @@ int test_String_split(void) {
 	for (int i = 0; i < nresults; i++) {
 		nerrors += CHECK(!String_compare(&results[i], &test[i]),
 			"%d-th split is incorrect. expected %.*s, found %.*s\n",
-			i, (int)results[i].size, results[i].str, (int)test[i].size, test[i].str);
+			i, (int)String_len(&results[i]), String_data(&results[i]), (int)String_len(&test[i]), String_data(&test[i]));
+		String_dest(&test[i]);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_split_whitespace(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	char const * raw = " \t path  to\n\r\vfile\f ";
+	String results[] = {
+		{.str = "path", .size = 4},
+		{.str = "to", .size = 2},
+		{.str = "file", .size = 4}
+	};
+	int nresults = sizeof(results) / sizeof(results[0]);
+	String input = {.str = (char *)raw, .size = strlen(raw)};
+
+	String test[4] = {0};
+	ptrdiff_t count = String_split(4, &test[0], &input, NULL);
+	nerrors += CHECK(nresults == count,
+		"failed to split on whitespace to the correct number. expected %d, found %d\n",
+		nresults, (int)count);
+	for (ptrdiff_t i = 0; i < count; i++) {
+		nerrors += CHECK(i < nresults && !String_compare(&results[i], &test[i]),
+			"%d-th split is incorrect. expected %.*s, found %.*s\n",
+			(int)i, (int)String_len(&results[i]), String_data(&results[i]), (int)String_len(&test[i]), 
+			String_data(&test[i]));
 		String_dest(&test[i]);
 	}
 
+	count = String_split(2, &test[0], &input, NULL);
+	nerrors += CHECK(2 == count,
+		"failed to limit the split on whitespace. expected %d, found %d\n", 2, (int)count);
+	for (ptrdiff_t i = 0; i < count; i++) {
+		String_dest(&test[i]);
+	}
+
+	input.size = 3; // " \t "
+	count = String_split(4, &test[0], &input, NULL);
+	nerrors += CHECK(0 == count,
+		"split of whitespace yielded strings. expected %d, found %d\n", 0, (int)count);
+
+	// long enough for the SIMD kernels, with tokens spanning blocks
+	char buf[300];
+	ptrdiff_t ntokens = 0;
+	for (ptrdiff_t i = 0; i < (ptrdiff_t)sizeof(buf); i++) {
+		buf[i] = (i % 37 < 30) ? 'x' : (i % 2 ? ' ' : '\t');
+		ntokens += buf[i] == 'x' && (!i || buf[i - 1] != 'x');
+	}
+	String many[16] = {0};
+	input = (String){.str = buf, .size = sizeof(buf)};
+	count = String_split(16, &many[0], &input, NULL);
+	nerrors += CHECK(ntokens == count,
+		"failed to split a long string on whitespace. expected %d, found %d\n", 
+		(int)ntokens, (int)count);
+	for (ptrdiff_t i = 0; i < count; i++) {
+		nerrors += CHECK(String_span(&many[i], &WHITESPACE_SET) == 0 && 
+			String_cspan(&many[i], &WHITESPACE_SET) == String_len(&many[i]),
+			"%d-th split contains whitespace\n", (int)i);
+		String_dest(&many[i]);
+	}
+
+	verbose_end(nerrors);
+	return nerrors;
+}
+
+int test_String_SplitIter(void) {
+	verbose_start(__func__);
+	int nerrors = 0;
+
+	struct {
+		char const * src;
+		char const * sep;
+		ptrdiff_t maxsplit;
+		_Bool reverse;
+		char const * pieces[5];
+	} cases[] = {
+		{"a,b,,c", ",", -1, false, {"a", "b", "", "c"}},
+		{"a,b,,c", ",", 1, false, {"a", "b,,c"}},
+		{"a,b,,c", ",", 1, true, {"c", "a,b,"}},
+		{"a,b,,c", ",", -1, true, {"c", "", "b", "a"}},
+		{"a::b::", "::", -1, false, {"a", "b", ""}},
+		{"", ",", -1, false, {""}},
+		{"abc", ",", 0, false, {"abc"}},
+		{"  a b\t\tc  ", NULL, -1, false, {"a", "b", "c"}},
+		{"  a b\t\tc  ", NULL, 1, false, {"a", "b\t\tc  "}},
+		{"  a b\t\tc  ", NULL, 1, true, {"c", "  a b"}},
+		{"  a b\t\tc  ", NULL, 0, false, {"a b\t\tc  "}},
+		{" \n ", NULL, -1, false, {NULL}},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		String str = {.str = (char *)cases[i].src, .size = strlen(cases[i].src)};
+		String sep = {.str = (char *)cases[i].sep, .size = cases[i].sep ? strlen(cases[i].sep) : 0};
+		String_SplitIter it;
+		String_SplitIter_init(&it, &str, cases[i].sep ? &sep : NULL, cases[i].maxsplit, 
+			cases[i].reverse);
+		String piece;
+		int j = 0;
+		while (String_SplitIter_next(&it, &piece)) {
+			char const * expected = j < 5 ? cases[i].pieces[j] : NULL;
+			nerrors += CHECK(expected && !String_compare(&piece, 
+				&(String){.str = (char *)expected, .size = strlen(expected)}),
+				"piece %d of splitting '%s' is incorrect. expected '%s', found '%.*s'\n",
+				j, cases[i].src, expected ? expected : "(none)", (int)String_len(&piece), String_data(&piece));
+			nerrors += CHECK(!piece.capacity && String_data(&piece) >= String_data(&str) && 
+				String_data(&piece) + String_len(&piece) <= String_data(&str) + String_len(&str),
+				"piece %d of splitting '%s' is not a view into the source\n", j, cases[i].src);
+			j++;
+		}
+		nerrors += CHECK(j >= 5 || !cases[i].pieces[j],
+			"splitting '%s' ended early after %d pieces\n", cases[i].src, j);
+	}
+
+	// stripping the pieces leaves the source alone, even when it is read-only
+	char source[] = "a,  b,c";
+	String str = {.str = source, .size = 7};
+	String_SplitIter it;
+	String_SplitIter_init(&it, &str, &(String){.str = ",", .size = 1}, -1, false);
+	String piece;
+	char const * stripped[] = {"a", "b", "c"};
+	int j = 0;
+	while (String_SplitIter_next(&it, &piece) && j < 3) {
+		String_strip(&piece, NULL);
+		nerrors += CHECK(!String_compare(&piece, &(String){.str = (char *)stripped[j], .size = 1}),
+			"stripped piece %d is '%.*s'\n", j, (int)String_len(&piece), String_data(&piece));
+		j++;
+	}
+	nerrors += CHECK(3 == j && !strcmp(source, "a,  b,c"), "stripping changed the source to '%s'\n",
+		source);
+	String literal = {.str = "  read-only", .size = 11};
+	String_lstrip(&literal, NULL);
+	nerrors += CHECK(!String_compare(&literal, &(String){.str = "read-only", .size = 9}), 
+		"failed to strip a view of a literal%s\n", "");
+
 	verbose_end(nerrors);
 	return nerrors;
 }
@@ -920,9 +2754,9 @@ int test_String_join(void) {
 		return nerrors;
 	}
 	
-	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)path_raw, strlen(path_raw)}),
+	nerrors += CHECK(!String_compare(&test, &(String){.str = (char *)path_raw, .size = strlen(path_raw)}),
 		"failed to join strings. expected %s, found %.*s\n",
-		path_raw, (int)test.size, test.str);
+		path_raw, (int)String_len(&test), String_data(&test));
 
 	String_dest(&test);
 	verbose_end(nerrors);
@@ -935,60 +2769,42 @@ int test_String_slice(void) {
 
 	String test = {0};
 
-	String src = {
-		.str = "I am the very model of a modern major general",
-		.size = 45
-	};
+	String src = {.str = "I am the very model of a modern major general", .size = 45};
 
-	String sl002 = {
-		.str = "Ia h eymdlo  oenmjrgnrl",
-		.size = 23
-	};
+	String sl002 = {.str = "Ia h eymdlo  oenmjrgnrl", .size = 23};
 	nerrors += -1 * String_slice(&test, &src, 0, 0, 2);
 	nerrors += CHECK(!String_compare(&test, &sl002),
 		"failed to slice '%.*s'[%d:%d:%d]. expected '%.*s', found '%.*s'\n",
-		(int)src.size, src.str, 0, 0, 2,
-		(int)sl002.size, sl002.str, (int)test.size, test.str);
+		(int)String_len(&src), String_data(&src), 0, 0, 2,
+		(int)String_len(&sl002), String_data(&sl002), (int)String_len(&test), String_data(&test));
 
-	String sl0442 = {
-		.str = "Ia h eymdlo  oenmjrgnr",
-		.size = 22
-	};
+	String sl0442 = {.str = "Ia h eymdlo  oenmjrgnr", .size = 22};
 	nerrors += -1 * String_slice(&test, &src, 0, 44, 2);
 	nerrors += CHECK(!String_compare(&test, &sl0442),
 		"failed to slice '%.*s'[%d:%d:%d]. expected '%.*s', found '%.*s'\n",
-		(int)src.size, src.str, 0, 44, 2,
-		(int)sl0442.size, sl0442.str, (int)test.size, test.str);
+		(int)String_len(&src), String_data(&src), 0, 44, 2,
+		(int)String_len(&sl0442), String_data(&sl0442), (int)String_len(&test), String_data(&test));
 
-	String sl102 = {
-		.str = " mtevr oe famdr ao eea",
-		.size = 22
-	};
+	String sl102 = {.str = " mtevr oe famdr ao eea", .size = 22};
 	nerrors += -1 * String_slice(&test, &src, 1, 0, 2);
 	nerrors += CHECK(!String_compare(&test, &sl102),
 		"failed to slice '%.*s'[%d:%d:%d]. expected '%.*s', found '%.*s'\n",
-		(int)src.size, src.str, 1, 0, 2,
-		(int)sl102.size, sl102.str, (int)test.size, test.str);
+		(int)String_len(&src), String_data(&src), 1, 0, 2,
+		(int)String_len(&sl102), String_data(&sl102), (int)String_len(&test), String_data(&test));
 
-	String sl1432 = {
-		.str = " mtevr oe famdr ao ee",
-		.size = 21
-	};
+	String sl1432 = {.str = " mtevr oe famdr ao ee", .size = 21};
 	nerrors += -1 * String_slice(&test, &src, 1, 43, 2);
 	nerrors += CHECK(!String_compare(&test, &sl1432),
 		"failed to slice '%.*s'[%d:%d:%d]. expected '%.*s', found '%.*s'\n",
-		(int)src.size, src.str, 1, 43, 2,
-		(int)sl1432.size, sl1432.str, (int)test.size, test.str);
+		(int)String_len(&src), String_data(&src), 1, 43, 2,
+		(int)String_len(&sl1432), String_data(&sl1432), (int)String_len(&test), String_data(&test));
 
-	String sl44m1m1 = {
-		.str = "lareneg rojam nredom a fo ledom yrev eht ma I",
-		.size = 45
-	};
+	String sl44m1m1 = {.str = "lareneg rojam nredom a fo ledom yrev eht ma I", .size = 45};
 	nerrors += -1 * String_slice(&test, &src, 44, -1, -1);
 	nerrors += CHECK(!String_compare(&test, &sl44m1m1),
 		"failed to slice '%.*s'[%d:%d:%d]. expected '%.*s', found '%.*s'\n",
-		(int)src.size, src.str, 44, -1, -1,
-		(int)sl44m1m1.size, sl44m1m1.str, (int)test.size, test.str);
+		(int)String_len(&src), String_data(&src), 44, -1, -1,
+		(int)String_len(&sl44m1m1), String_data(&sl44m1m1), (int)String_len(&test), String_data(&test));
 
 	String_dest(&test);
 	verbose_end(nerrors);
@@ -1012,13 +2828,18 @@ int main(int narg, char ** args) {
 		}
 	}
 	int nerrors = 0;
+	nerrors += test_String_simd_first_use();
 	nerrors += test_setup();
 	nerrors += test_String_is_empty();
 	nerrors += test_String_compare();
+	nerrors += test_String_mismatch();
+	nerrors += test_String_hash();
 	nerrors += test_String_in();
 	nerrors += test_String_char_in();
 	nerrors += test_String_lower();
 	nerrors += test_String_upper();
+	nerrors += test_String_case();
+	nerrors += test_String_translate();
 	nerrors += test_String_get();
 	nerrors += test_String_set();
 	nerrors += test_String_starts_with();
@@ -1026,9 +2847,27 @@ int main(int narg, char ** args) {
 	nerrors += test_String_find();
 	nerrors += test_String_rfind();
 	nerrors += test_String_count();
+	nerrors += test_String_search_exhaustive();
+	nerrors += test_String_simd_find();
+	nerrors += test_String_Pattern();
+	nerrors += test_String_find_any();
+	nerrors += test_String_replace_many();
+	nerrors += test_String_Map();
+	nerrors += test_String_Intern();
+	nerrors += test_String_ConcurrentIntern();
+	nerrors += test_String_Arena();
+	nerrors += test_String_Allocator();
+	nerrors += test_String_sso();
+	nerrors += test_String_reserve();
+	nerrors += test_String_Builder();
+	nerrors += test_String_Rope();
+	nerrors += test_String_share();
+	nerrors += test_String_view_writes();
+	nerrors += test_String_find_all();
 	nerrors += test_String_lstrip();
 	nerrors += test_String_rstrip();
 	nerrors += test_String_strip();
+	nerrors += test_String_span();
 	nerrors += test_String_partition();
 	nerrors += test_String_rpartition();
 	nerrors += test_String_expand_tabs();
@@ -1036,6 +2875,8 @@ int main(int narg, char ** args) {
 	nerrors += test_String_extend();
 	nerrors += test_String_replace();
 	nerrors += test_String_split();
+	nerrors += test_String_split_whitespace();
+	nerrors += test_String_SplitIter();
 	nerrors += test_String_join();
 	nerrors += test_String_slice();
 	nerrors += test_tear_down();